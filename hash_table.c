@@ -5,285 +5,1798 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "hash_table.h"
+#include "ht_arena.h"
 
+// SSE2 is part of x86-64, AVX2 is checked at runtime. Build with -DHT_NO_SIMD for the scalar path
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(HT_NO_SIMD)
+#define HT_GROUP_X86 1
+#include <immintrin.h>
+#endif
 
-/* Empty element */
-static ht_item HT_DELETED_ITEM = {NULL, NULL};
+
+/* Slot states stored in ht_slot.hash; real hashes are moved off these values */
+#define HT_HASH_EMPTY   0
+#define HT_HASH_DELETED 1
+
+/* Control bytes of the group engine: a full slot holds the 7-bit tag of its hash */
+#define HT_CTRL_EMPTY    0x80
+#define HT_CTRL_DELETED  0xFE
+#define HT_CTRL_SENTINEL 0xFF   // padding after the last slot, never matched
+
+/* Group matchers: one group is 16 control bytes (scalar, SSE2) or 32 (AVX2) */
+#define HT_ISA_SCALAR 0
+#define HT_ISA_SSE2   1
+#define HT_ISA_AVX2   2
+#define HT_GROUP_MAX  32
+
+/* Old buckets moved by every operation while an incremental resize runs */
+#define HT_MIGRATE_STEP 64
+
+/* Highest grow threshold: probing needs free slots */
+#define HT_MAX_GROW_LOAD 95
+
+/* Least gap, in load points, between the load after a shrink and the grow threshold */
+#define HT_LOAD_BAND 10
+
+/* Index returned by the lookups when the key is not there */
+#define HT_NOT_FOUND ((size_t)-1)
+
+/* Batches: keys hashed per block, home buckets prefetched this many keys ahead
+   (ht_search_batch: this many lookups in flight) */
+#define HT_BATCH          64
+#define HT_PREFETCH_AHEAD 16
+
+/* States of a lookup in flight of ht_search_batch */
+#define HT_AMAC_DONE    0   // lane free
+#define HT_AMAC_PROBE   1   // the slot at probe.index is being fetched
+#define HT_AMAC_COMPARE 2   // its hash matched, the stored key is being fetched
+
+static int ht_resize(ht_hash_table* ht, const size_t base_size);
+static int ht_resize_up(ht_hash_table* ht);
+static void ht_resize_down(ht_hash_table* ht);
+static void ht_purge(ht_hash_table* ht);
+static void ht_migrate(ht_hash_table* ht, size_t buckets);
+
+
+static int ht_group_isa(void);
+
+
+/****** ALLOCATOR ******/
+static void* ht_std_alloc(void* ctx, const size_t size)
+{
+    (void)ctx;
+    return malloc(size);
+}
+
+static void* ht_std_alloc_zeroed(void* ctx, const size_t count, const size_t size)
+{
+    (void)ctx;
+    return calloc(count, size);
+}
+
+static void ht_std_free(void* ctx, void* p)
+{
+    (void)ctx;
+    free(p);
+}
+
+/* Allocator of the tables created without one */
+static const ht_allocator HT_STD_ALLOCATOR = {
+    ht_std_alloc, ht_std_alloc_zeroed, ht_std_free, NULL
+};
+
+/* Shorthands for the allocator of a table */
+static inline void* ht_alloc(const ht_hash_table* ht, const size_t size)
+{
+    return ht->config.allocator->alloc(ht->config.allocator->ctx, size);
+}
+
+static inline void ht_mfree(const ht_hash_table* ht, void* p)
+{
+    ht->config.allocator->free(ht->config.allocator->ctx, p);
+}
 
 
 /******* ADD *******/
 /**
    #Internal
-   * Given a key and a value, return a new item
-   @param char* k: key
-   @param char* v: value
-   @return ht_item element
+   * Copy len bytes in a new NUL-terminated buffer
+   * (the terminator lets string values be returned as C strings)
+   @param void* s: the bytes
+   @param size_t len: the number of bytes
+   @return the new buffer
+ **/
+static void* ht_strndup(const ht_hash_table* ht, const void* s, const size_t len)
+{
+    char* d = ht_alloc(ht, len + 1);
+    if (d == NULL) return NULL;
+    memcpy(d, s, len);
+    d[len] = '\0';
+    return d;
+}
+
+/**
+   #Internal
+   * Whether the keys (or values) are copies made in the table arena:
+   * copies with neither a dup nor a free callback
+ **/
+static inline int ht_in_arena(const ht_hash_table* ht, const ht_ownership own,
+                              const ht_dup_fn dup, const ht_free_fn free_fn)
+{
+    return ht->arena != NULL && own == HT_OWN_COPY && dup == NULL && free_fn == NULL;
+}
+
+/**
+   #Internal
+   * Key or value as stored in a slot, by the ownership policy of the table:
+   * a copy (dup callback, arena, or ht_strndup), or the caller pointer itself
+ **/
+static inline void* ht_own(const ht_hash_table* ht, const ht_ownership own,
+                           const ht_dup_fn dup, const ht_free_fn free_fn,
+                           const void* p, const size_t len)
+{
+    if (own != HT_OWN_COPY) {
+        return (void*)p;
+    }
+    if (dup != NULL) {
+        return dup(p, len);
+    }
+    if (ht_in_arena(ht, own, dup, free_fn)) {
+        char* d = ht_arena_alloc(ht->arena, len + 1);
+        if (d == NULL) return NULL;
+        memcpy(d, p, len);
+        d[len] = '\0';
+        return d;
+    }
+    return ht_strndup(ht, p, len);
+}
+
+/**
+   #Internal
+   * Store a key or value in a slot field, by the ownership policy of the table.
+   * A default copy of up to inline_max bytes is written in the field itself
+   * (NUL-terminated when shorter than the field) and its length tagged
+   * HT_LEN_INLINE.
+   @param void** field: slot->key or slot->value
+   @param uint32_t* field_len: slot->key_len or slot->value_len
+   @param size_t inline_max: HT_INLINE_MAX, or HT_INLINE_VALUE_MAX for fixed-width values
+   @return 0, -1 if the copy failed (out of memory, or dup returned NULL)
+ **/
+static inline int ht_store(const ht_hash_table* ht, const ht_ownership own,
+                            const ht_dup_fn dup, const ht_free_fn free_fn,
+                            void** field, uint32_t* field_len,
+                            const void* p, const size_t len, const size_t inline_max)
+{
+    if (own == HT_OWN_COPY && dup == NULL && free_fn == NULL && len <= inline_max) {
+        char* d = (char*)field;
+        memcpy(d, p, len);
+        if (len < sizeof(*field)) {
+            d[len] = '\0';
+        }
+        *field_len = (uint32_t)len | HT_LEN_INLINE;
+        return 0;
+    }
+    *field = ht_own(ht, own, dup, free_fn, p, len);
+    *field_len = (uint32_t)len;
+    return own == HT_OWN_COPY && *field == NULL ? -1 : 0;
+}
+
+/**
+   #Internal
+   * Release a stored key or value of len bytes, unless it is borrowed
+   * or kept in its slot (len tagged HT_LEN_INLINE)
+ **/
+static inline void ht_release(const ht_hash_table* ht, const ht_ownership own,
+                              const ht_dup_fn dup, const ht_free_fn free_fn,
+                              void* p, const size_t len)
+{
+    if (own == HT_OWN_BORROW || (len & HT_LEN_INLINE)) {
+        return;
+    }
+    if (ht_in_arena(ht, own, dup, free_fn)) {
+        ht_arena_free(ht->arena, p, len + 1);
+    } else if (free_fn != NULL) {
+        free_fn(p);
+    } else {
+        ht_mfree(ht, p);
+    }
+}
+
+/* Longest value kept in its slot */
+static inline size_t ht_value_inline_max(const ht_hash_table* ht)
+{
+    return ht->config.inline_values ? HT_INLINE_VALUE_MAX : HT_INLINE_MAX;
+}
+
+/**
+   #Internal
+   * Fill an empty slot with key and value (copies, or the pointers themselves)
+   @param ht_slot* slot: the slot
+   @param uint64_t hash: the key hash
+   @param void* k: key
+   @param size_t klen: key length
+   @param void* v: value
+   @param size_t vlen: value length
+   @return 0, -1 if a copy failed (the key copy is undone; a taken or
+           borrowed key is left to the caller)
+ **/
+static int ht_slot_fill(const ht_hash_table* ht, ht_slot* slot, const uint64_t hash,
+                        const void* k, const size_t klen,
+                        const void* v, const size_t vlen)
+{
+    const ht_config* cfg = &ht->config;
+    slot->hash = hash;
+    if (ht_store(ht, cfg->key_own, cfg->key_dup, cfg->key_free,
+                 &slot->key, &slot->key_len, k, klen, HT_INLINE_MAX) != 0) {
+        return -1;
+    }
+    if (ht_store(ht, cfg->value_own, cfg->value_dup, cfg->value_free,
+                 &slot->value, &slot->value_len, v, vlen, ht_value_inline_max(ht)) != 0) {
+        if (cfg->key_own == HT_OWN_COPY) {
+            ht_release(ht, cfg->key_own, cfg->key_dup, cfg->key_free, slot->key, slot->key_len);
+        }
+        return -1;
+    }
+    return 0;
+}
+
+/* Key and value bytes of an occupied slot: in the slot itself, or behind its pointer */
+static inline void* ht_slot_key(const ht_slot* slot)
+{
+    return slot->key_len & HT_LEN_INLINE ? (void*)slot->key_bytes : slot->key;
+}
+
+static inline void* ht_slot_value(const ht_slot* slot)
+{
+    return slot->value_len & HT_LEN_INLINE ? (void*)slot->value_bytes : slot->value;
+}
+
+
+/**
+   #Internal
+   * Create a new Hash Table of a certain size
+   @param size_t base_size: the initial size
+   @param ht_config* cfg: the options (with an allocator)
+   @return ht_hash_table the pointer to the new Hash Table
+ **/
+
+static ht_hash_table* ht_new_sized(const size_t base_size, const ht_config* cfg)
+{
+    const ht_allocator* a = cfg->allocator;
+    ht_hash_table* ht = a->alloc(a->ctx, sizeof(ht_hash_table));
+    if(ht == NULL) return NULL;
+    ht->config = *cfg;
+    ht->base_size = base_size;
+    ht->shift = 0;
+    ht->prime = NULL;
+    if (cfg->sizing == HT_SIZE_POW2) {
+        ht->shift = 64;
+        for (ht->size = 1; ht->size < base_size; ht->size <<= 1) {
+            ht->shift--;
+        }
+    } else {
+        // tabulated: no primality test on the resize path
+        ht->prime = next_prime_size(ht->base_size);
+        ht->size = ht->prime->p;
+    }
+    // a base off the size ladder is rounded up: grows and shrinks step from there
+    ht->base_size = ht->size;
+    ht->count = 0;
+    ht->deleted = 0;
+    ht->old = NULL;
+    ht->migrate_pos = 0;
+    ht->arena = NULL;
+    // zeroed: every slot starts as HT_HASH_EMPTY
+    ht->slots = a->alloc_zeroed(a->ctx, ht->size, sizeof(ht_slot));
+    if(ht->slots == NULL) {
+        a->free(a->ctx, ht);
+        return NULL;
+    }
+
+    ht->ctrl = NULL;
+    ht->group_isa = HT_ISA_SCALAR;
+    if (cfg->probe == HT_PROBE_GROUP) {
+        // padded to whole groups of the widest matcher
+        const size_t ctrl_len = (ht->size + HT_GROUP_MAX - 1) / HT_GROUP_MAX * HT_GROUP_MAX;
+        ht->ctrl = a->alloc(a->ctx, ctrl_len);
+        if(ht->ctrl == NULL) {
+            a->free(a->ctx, ht->slots);
+            a->free(a->ctx, ht);
+            return NULL;
+        }
+        memset(ht->ctrl, HT_CTRL_EMPTY, ht->size);
+        memset(ht->ctrl + ht->size, HT_CTRL_SENTINEL, ctrl_len - ht->size);
+        ht->group_isa = ht_group_isa();
+    }
+
+    return ht;
+}
+
+/** Fill a config with the default options **/
+void ht_config_init(ht_config* cfg)
+{
+    cfg->hash = ht_hash_wyhash;
+    cfg->seed = HT_DEFAULT_SEED;
+    cfg->probe = HT_PROBE_DOUBLE;
+    cfg->incremental_resize = 0;
+    cfg->sizing = HT_SIZE_PRIME;
+    cfg->key_size = 0;
+    cfg->value_size = 0;
+    cfg->key_eq = NULL;
+    cfg->key_own = HT_OWN_COPY;
+    cfg->value_own = HT_OWN_COPY;
+    cfg->key_dup = NULL;
+    cfg->key_free = NULL;
+    cfg->value_dup = NULL;
+    cfg->value_free = NULL;
+    cfg->arena = 0;
+    cfg->allocator = NULL;
+    cfg->grow_load = HT_DEFAULT_GROW_LOAD;
+    cfg->shrink_load = HT_DEFAULT_SHRINK_LOAD;
+    cfg->min_capacity = 0;
+    cfg->inline_values = 0;
+}
+
+/** Create a new Hash Table of fixed size **/
+ht_hash_table* ht_new()
+{
+    return ht_new_ex(NULL);
+}
+
+/**
+   #Internal
+   * Base size holding capacity entries without growing: the entries stay
+   * at or under the grow_load checked by insert
+ **/
+static size_t ht_capacity_base(const unsigned grow_load, const size_t capacity)
+{
+    const size_t base_size = capacity / grow_load * 100 +
+        (capacity % grow_load) * 100 / grow_load + 1;
+    return base_size > HT_INITIAL_BASE_SIZE ? base_size : HT_INITIAL_BASE_SIZE;
+}
+
+/**
+   #Internal
+   * Create a table with the given options, defaults filled in and
+   * load thresholds brought in range, sized for capacity entries
+ **/
+static ht_hash_table* ht_new_base(const ht_config* cfg, const size_t capacity)
+{
+    ht_config def;
+    if (cfg == NULL) {
+        ht_config_init(&def);
+    } else {
+        def = *cfg;
+    }
+    if (def.hash == NULL) {
+        def.hash = ht_hash_wyhash;
+    }
+    if (def.allocator == NULL) {
+        def.allocator = &HT_STD_ALLOCATOR;
+    }
+    if (def.grow_load == 0) {
+        def.grow_load = HT_DEFAULT_GROW_LOAD;
+    } else if (def.grow_load > HT_MAX_GROW_LOAD) {
+        def.grow_load = HT_MAX_GROW_LOAD;
+    }
+    // hysteresis: a shrink takes the next size down (about half), so it
+    // doubles the load; it must land at least HT_LOAD_BAND points under the
+    // grow threshold (ht_resize_down checks the load it lands at, too)
+    if (def.shrink_load * 2 + HT_LOAD_BAND > def.grow_load) {
+        def.shrink_load = def.grow_load > HT_LOAD_BAND ? (def.grow_load - HT_LOAD_BAND) / 2 : 0;
+    }
+
+    // fixed-width values only, copied by the table itself
+    if (def.value_size == 0 || def.value_size > HT_INLINE_VALUE_MAX ||
+        def.value_own != HT_OWN_COPY || def.value_dup != NULL || def.value_free != NULL) {
+        def.inline_values = 0;
+    }
+
+    const size_t entries = capacity > def.min_capacity ? capacity : def.min_capacity;
+    ht_hash_table* ht = ht_new_sized(ht_capacity_base(def.grow_load, entries), &def);
+    if (ht != NULL && def.arena) {
+        ht->arena = ht_arena_new(def.allocator);
+    }
+    return ht;
+}
+
+/** Create a new Hash Table with the given options **/
+ht_hash_table* ht_new_ex(const ht_config* cfg)
+{
+    return ht_new_base(cfg, 0);
+}
+
+/** Create a new Hash Table sized for capacity entries **/
+ht_hash_table* ht_new_with_capacity(const size_t capacity)
+{
+    return ht_new_base(NULL, capacity);
+}
+
+/** Grow the Hash Table to hold capacity entries without resizing **/
+int ht_reserve(ht_hash_table* ht, const size_t capacity)
+{
+    const size_t base_size = ht_capacity_base(ht->config.grow_load, capacity);
+    if (base_size > ht->base_size) {
+        return ht_resize(ht, base_size);
+    }
+    return 0;
+}
+
+
+/******** REMOVE *********/
+/**
+   #Internal
+   * Given the slot, free its key and value
+   @param ht_hash_table* ht: the table owning the slot
+   @param ht_slot: the pointer to an occupied slot
+ **/
+static void ht_slot_free(const ht_hash_table* ht, ht_slot* slot)
+{
+    const ht_config* cfg = &ht->config;
+    ht_release(ht, cfg->key_own, cfg->key_dup, cfg->key_free, slot->key, slot->key_len);
+    ht_release(ht, cfg->value_own, cfg->value_dup, cfg->value_free, slot->value, slot->value_len);
+}
+
+/**
+   #Internal
+   * Free the entries and the arrays of a table (or of an old array shell).
+   * Arena copies are not freed one by one: the arena goes at once.
+ **/
+static void ht_free_slots(ht_hash_table* ht)
+{
+    const ht_config* cfg = &ht->config;
+    const int walk_keys = cfg->key_own != HT_OWN_BORROW &&
+        !ht_in_arena(ht, cfg->key_own, cfg->key_dup, cfg->key_free);
+    const int walk_values = cfg->value_own != HT_OWN_BORROW &&
+        !ht_in_arena(ht, cfg->value_own, cfg->value_dup, cfg->value_free);
+    for (size_t i = 0; (walk_keys || walk_values) && i < ht->size; i++) {
+        ht_slot* slot = &ht->slots[i];
+        if (slot->hash == HT_HASH_EMPTY || slot->hash == HT_HASH_DELETED) {
+            continue;
+        }
+        if (walk_keys) {
+            ht_release(ht, cfg->key_own, cfg->key_dup, cfg->key_free, slot->key, slot->key_len);
+        }
+        if (walk_values) {
+            ht_release(ht, cfg->value_own, cfg->value_dup, cfg->value_free,
+                       slot->value, slot->value_len);
+        }
+    }
+    ht_mfree(ht, ht->slots);
+    ht_mfree(ht, ht->ctrl);
+}
+
+/** Free memory allocated for the Hash Table **/
+void ht_del_hash_table(ht_hash_table* ht)
+{
+    if (ht->old != NULL) {
+        ht_free_slots(ht->old);
+        ht_mfree(ht, ht->old);
+    }
+    ht_free_slots(ht);
+    if (ht->arena != NULL) {
+        ht_arena_del(ht->arena);
+    }
+    ht_mfree(ht, ht);
+}
+
+
+/****** HASH FUNCTION ******/
+/**
+   #Internal
+   * 64x64 -> 128 bit multiply, returning low and high halves in place
+ **/
+static inline void ht_mum(uint64_t* a, uint64_t* b)
+{
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = (__uint128_t)*a * *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#else
+    const uint64_t ha = *a >> 32, hb = *b >> 32;
+    const uint64_t la = (uint32_t)*a, lb = (uint32_t)*b;
+    const uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    const uint64_t t = rl + (rm0 << 32);
+    uint64_t c = t < rl;
+    const uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t ht_mix(uint64_t a, uint64_t b)
+{
+    ht_mum(&a, &b);
+    return a ^ b;
+}
+
+static inline uint64_t ht_read8(const uint8_t* p)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline uint64_t ht_read4(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+/* wyhash secret */
+static const uint64_t HT_WYP[4] = {
+    0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL,
+    0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL
+};
+
+/**
+   * wyhash: keys up to 16 bytes are read with (overlapping) loads and need
+   * no loop at all; longer keys are consumed 48 then 16 bytes per round.
+   * Every round is a 64x64->128 multiply, so the result stays well
+   * distributed over all 64 bits whatever the key length.
+ **/
+uint64_t ht_hash_wyhash(const void* key, size_t len, uint64_t seed)
+{
+    const uint8_t* p = key;
+    uint64_t a, b;
+
+    seed ^= ht_mix(seed ^ HT_WYP[0], HT_WYP[1]);
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (ht_read4(p) << 32) | ht_read4(p + ((len >> 3) << 2));
+            b = (ht_read4(p + len - 4) << 32) | ht_read4(p + len - 4 - ((len >> 3) << 2));
+        } else if (len > 0) {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+        if (i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = ht_mix(ht_read8(p) ^ HT_WYP[1], ht_read8(p + 8) ^ seed);
+                see1 = ht_mix(ht_read8(p + 16) ^ HT_WYP[2], ht_read8(p + 24) ^ see1);
+                see2 = ht_mix(ht_read8(p + 32) ^ HT_WYP[3], ht_read8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = ht_mix(ht_read8(p) ^ HT_WYP[1], ht_read8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = ht_read8(p + i - 16);
+        b = ht_read8(p + i - 8);
+    }
+    a ^= HT_WYP[1];
+    b ^= seed;
+    ht_mum(&a, &b);
+    return ht_mix(a ^ HT_WYP[0] ^ len, b ^ HT_WYP[1]);
+}
+
+/** FNV-1a 64-bit hash **/
+uint64_t ht_hash_fnv1a(const void* key, size_t len, uint64_t seed)
+{
+    const uint8_t* p = key;
+    uint64_t hash = 0xcbf29ce484222325ULL ^ seed;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/**
+   #Internal
+   * Hash a key with the kernel chosen at creation.
+   * Called once per operation: the probe sequence is derived from the result,
+   * and the result is cached in the slot.
+   * The two values reserved for slot states are moved out of the way.
+   @param ht_hash_table* ht: the Hash Table
+   @param void* s: the key
+   @param size_t len: the key length
+   @return the 64-bit hash of the key
+**/
+static inline uint64_t ht_hash(const ht_hash_table* ht, const void* s, const size_t len)
+{
+    const uint64_t hash = ht->config.hash(s, len, ht->config.seed);
+    return hash > HT_HASH_DELETED ? hash : hash + 2;
+}
+
+/**
+   #Internal
+   * Whether an occupied slot holds the given key.
+   * The cached hash and the length reject almost every mismatch
+   * before the key bytes are touched (or config.key_eq called).
+ **/
+static inline int ht_slot_match(const ht_hash_table* ht, const ht_slot* slot,
+                                const uint64_t hash, const void* key, const size_t len)
+{
+    if (slot->hash != hash) {
+        return 0;
+    }
+    const size_t key_len = slot->key_len & ~HT_LEN_INLINE;
+    if (ht->config.key_eq != NULL) {
+        return ht->config.key_eq(ht_slot_key(slot), key_len, key, len);
+    }
+    return key_len == len && memcmp(ht_slot_key(slot), key, len) == 0;
+}
+
+/**
+   #Internal
+   * Length of a key or a value: the configured size, or strlen for strings
+ **/
+static inline size_t ht_len(const void* p, const size_t size)
+{
+    return size != 0 ? size : strlen(p);
+}
+
+/**
+   #Internal
+   * Home bucket of a hash, shared by all the engines.
+   * Power-of-two tables use a Fibonacci (multiply-shift) reduction: the top
+   * bits of hash * 2^64/phi, which depend on every bit of the hash.
+   * Prime tables take hash % size with fastmod, multiplies instead of a divide.
+ **/
+static inline size_t ht_home(const ht_hash_table* ht, const uint64_t hash)
+{
+    if (ht->config.sizing == HT_SIZE_POW2) {
+        return (size_t)((hash * HT_FIBONACCI) >> ht->shift);
+    }
+    return (size_t)fastmod(hash, ht->prime);
+}
+
+/**
+   #Internal
+   * Double hashing probe sequence to handling collitions
+   * pseudo-code: index = (hash_a + i*hash_b) % num_buckets
+   * Both components are split out of the one 64-bit hash when the probe starts:
+   * hash_a (home bucket) from the whole hash and hash_b (step), in [1, num_buckets-1],
+   * from its halves swapped (0 taken as 1), so with a prime num_buckets every
+   * bucket is visited.
+   * Moving to the next attempt is then one add and one compare, no division.
+   *
+   * Power-of-two tables probe a triangular sequence instead:
+   * index = (home + i*(i+1)/2) & (num_buckets-1), which also visits every
+   * bucket when num_buckets is a power of two, with no division at all.
+ **/
+typedef struct {
+    size_t index;
+    size_t step;
+} ht_probe;
+
+static inline ht_probe ht_probe_start(const ht_hash_table* ht, const uint64_t hash)
+{
+    ht_probe p;
+    p.index = ht_home(ht, hash);
+    if (ht->config.sizing == HT_SIZE_POW2) {
+        p.step = 1;
+    } else {
+        const size_t step = (size_t)fastmod((hash >> 32) | (hash << 32), ht->prime);
+        p.step = step != 0 ? step : 1;
+    }
+    return p;
+}
+
+static inline void ht_probe_next(const ht_hash_table* ht, ht_probe* p)
+{
+    if (ht->config.sizing == HT_SIZE_POW2) {
+        p->index = (p->index + p->step++) & (ht->size - 1);
+        return;
+    }
+    // index and step are both below num_buckets: one subtraction wraps it
+    p->index += p->step;
+    if (p->index >= ht->size) {
+        p->index -= ht->size;
+    }
+}
+
+
+/**
+   #Internal
+   * Double hashing lookup
+   @param ht_hash_table* ht: the Hash Table
+   @param uint64_t hash: the key hash
+   @param void* key: the key
+   @param size_t len: the key length
+   @param size_t* free_slot: if not NULL, set to the first deleted slot of the
+                          probe, or else the empty slot ending it
+   @return the index of the slot holding key, or HT_NOT_FOUND
+ **/
+static size_t ht_double_lookup(const ht_hash_table* ht, const uint64_t hash,
+                               const void* key, const size_t len, size_t* free_slot)
+{
+    // get the first index of bucket and point it
+    ht_probe probe = ht_probe_start(ht, hash);
+    const ht_slot* slot = &ht->slots[probe.index];
+    size_t first_deleted = HT_NOT_FOUND;
+
+    // loop untill elements exist
+    while (slot->hash != HT_HASH_EMPTY) {
+        // deleted slots never match: HT_HASH_DELETED is not a valid hash
+        if (ht_slot_match(ht, slot, hash, key, len)) {
+            return probe.index;
+        }
+        if (slot->hash == HT_HASH_DELETED && first_deleted == HT_NOT_FOUND) {
+            first_deleted = probe.index;
+        }
+        // else, go ahead
+        ht_probe_next(ht, &probe);
+        slot = &ht->slots[probe.index];
+    }
+    if (free_slot != NULL) {
+        *free_slot = first_deleted != HT_NOT_FOUND ? first_deleted : probe.index;
+    }
+    return HT_NOT_FOUND;
+}
+
+
+/****** GROUP PROBING ******/
+/**
+   #Internal
+   * SwissTable-style engine. Next to the slots, ht->ctrl keeps one byte per slot:
+   * HT_CTRL_EMPTY, HT_CTRL_DELETED, or the top 7 bits of the hash for a full slot.
+   * A lookup compares a whole group of control bytes against the tag at once,
+   * so only tag matches (1/128 false positive rate per full slot) reach the
+   * slot and key memory, and a miss usually ends at its first group because
+   * the group holds an empty byte.
+   * Groups are probed linearly from the group of the home bucket.
+ **/
+static inline uint8_t ht_ctrl_tag(const uint64_t hash)
+{
+    return (uint8_t)(hash >> 57);
+}
+
+static inline size_t ht_group_width(const int isa)
+{
+    return isa == HT_ISA_AVX2 ? 32 : 16;
+}
+
+/** Runtime CPU check, done once per table **/
+static int ht_group_isa(void)
+{
+#if defined(HT_GROUP_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return HT_ISA_AVX2;
+    }
+    return HT_ISA_SSE2;
+#else
+    return HT_ISA_SCALAR;
+#endif
+}
+
+/* scalar fallback: one byte at a time */
+static inline uint32_t ht_match_scalar(const uint8_t* ctrl, const uint8_t b)
+{
+    uint32_t m = 0;
+    for (int i = 0; i < 16; i++) {
+        m |= (uint32_t)(ctrl[i] == b) << i;
+    }
+    return m;
+}
+
+static inline uint32_t ht_match_free_scalar(const uint8_t* ctrl)
+{
+    uint32_t m = 0;
+    for (int i = 0; i < 16; i++) {
+        m |= (uint32_t)(ctrl[i] == HT_CTRL_EMPTY || ctrl[i] == HT_CTRL_DELETED) << i;
+    }
+    return m;
+}
+
+#if defined(HT_GROUP_X86)
+static inline uint32_t ht_match_sse2(const uint8_t* ctrl, const uint8_t b)
+{
+    const __m128i c = _mm_loadu_si128((const __m128i*)ctrl);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8((char)b)));
+}
+
+// empty (-128) and deleted (-2) are the only control bytes below sentinel (-1)
+static inline uint32_t ht_match_free_sse2(const uint8_t* ctrl)
+{
+    const __m128i c = _mm_loadu_si128((const __m128i*)ctrl);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), c));
+}
+
+__attribute__((target("avx2")))
+static inline uint32_t ht_match_avx2(const uint8_t* ctrl, const uint8_t b)
+{
+    const __m256i c = _mm256_loadu_si256((const __m256i*)ctrl);
+    return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, _mm256_set1_epi8((char)b)));
+}
+
+__attribute__((target("avx2")))
+static inline uint32_t ht_match_free_avx2(const uint8_t* ctrl)
+{
+    const __m256i c = _mm256_loadu_si256((const __m256i*)ctrl);
+    return (uint32_t)_mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_set1_epi8(-1), c));
+}
+#endif
+
+/* Matcher dispatch: isa is a constant wherever these are inlined */
+static inline __attribute__((always_inline))
+uint32_t ht_group_match(const uint8_t* ctrl, const uint8_t b, const int isa)
+{
+#if defined(HT_GROUP_X86)
+    if (isa == HT_ISA_AVX2) {
+        return ht_match_avx2(ctrl, b);
+    }
+    return ht_match_sse2(ctrl, b);
+#else
+    (void)isa;
+    return ht_match_scalar(ctrl, b);
+#endif
+}
+
+static inline __attribute__((always_inline))
+uint32_t ht_group_match_free(const uint8_t* ctrl, const int isa)
+{
+#if defined(HT_GROUP_X86)
+    if (isa == HT_ISA_AVX2) {
+        return ht_match_free_avx2(ctrl);
+    }
+    return ht_match_free_sse2(ctrl);
+#else
+    (void)isa;
+    return ht_match_free_scalar(ctrl);
+#endif
+}
+
+/**
+   #Internal
+   * Group lookup, written once and specialized per matcher by the wrappers
+   * below (isa is a constant in each of them).
+   * With a NULL key, only the free slot is looked for.
+   @param size_t* free_slot: if not NULL, set to the first empty or deleted slot
+                          on the probe path, where key can be inserted
+   @return the index of the slot holding key, or HT_NOT_FOUND
+ **/
+static inline __attribute__((always_inline))
+size_t ht_group_lookup_isa(const ht_hash_table* ht, const uint64_t hash,
+                           const void* key, const size_t len, size_t* free_slot,
+                           const int isa)
+{
+    const size_t width = ht_group_width(isa);
+    const size_t num_groups = (ht->size + width - 1) / width;
+    const uint8_t tag = ht_ctrl_tag(hash);
+    size_t group = ht_home(ht, hash) / width;
+    size_t first_free = HT_NOT_FOUND;
+
+    for (size_t n = 0; n < num_groups; n++) {
+        const uint8_t* ctrl = ht->ctrl + group * width;
+        uint32_t match = key != NULL ? ht_group_match(ctrl, tag, isa) : 0;
+        while (match != 0) {
+            const size_t index = group * width + (size_t)__builtin_ctz(match);
+            if (ht_slot_match(ht, &ht->slots[index], hash, key, len)) {
+                return index;
+            }
+            match &= match - 1;
+        }
+        if (free_slot != NULL && first_free == HT_NOT_FOUND) {
+            const uint32_t free_mask = ht_group_match_free(ctrl, isa);
+            if (free_mask != 0) {
+                first_free = group * width + (size_t)__builtin_ctz(free_mask);
+                if (key == NULL) {
+                    break;
+                }
+            }
+        }
+        // an empty byte in the group: key cannot be further away
+        if (ht_group_match(ctrl, HT_CTRL_EMPTY, isa) != 0) {
+            break;
+        }
+        if (++group == num_groups) {
+            group = 0;
+        }
+    }
+    if (free_slot != NULL) {
+        *free_slot = first_free;
+    }
+    return HT_NOT_FOUND;
+}
+
+#if defined(HT_GROUP_X86)
+static size_t ht_group_lookup_sse2(const ht_hash_table* ht, const uint64_t hash,
+                                   const void* key, const size_t len, size_t* free_slot)
+{
+    return ht_group_lookup_isa(ht, hash, key, len, free_slot, HT_ISA_SSE2);
+}
+
+__attribute__((target("avx2")))
+static size_t ht_group_lookup_avx2(const ht_hash_table* ht, const uint64_t hash,
+                                   const void* key, const size_t len, size_t* free_slot)
+{
+    return ht_group_lookup_isa(ht, hash, key, len, free_slot, HT_ISA_AVX2);
+}
+#else
+static size_t ht_group_lookup_scalar(const ht_hash_table* ht, const uint64_t hash,
+                                     const void* key, const size_t len, size_t* free_slot)
+{
+    return ht_group_lookup_isa(ht, hash, key, len, free_slot, HT_ISA_SCALAR);
+}
+#endif
+
+
+/** Group lookup with the matcher picked at creation **/
+static inline size_t ht_group_lookup(const ht_hash_table* ht, const uint64_t hash,
+                                     const void* key, const size_t len, size_t* free_slot)
+{
+#if defined(HT_GROUP_X86)
+    if (ht->group_isa == HT_ISA_AVX2) {
+        return ht_group_lookup_avx2(ht, hash, key, len, free_slot);
+    }
+    return ht_group_lookup_sse2(ht, hash, key, len, free_slot);
+#else
+    return ht_group_lookup_scalar(ht, hash, key, len, free_slot);
+#endif
+}
+
+
+/****** ROBIN HOOD PROBING ******/
+/**
+   #Internal
+   * Linear probing where an insert takes the slot of any entry that is closer
+   * to its home bucket than the new one ("rob the rich"). Distances from home
+   * stay close to the mean, and a lookup can stop as soon as it meets an entry
+   * closer to home than itself. Delete shifts the following entries of the
+   * cluster back by one, so the engine never leaves tombstones.
+   * The distance of a stored entry comes from its cached hash.
  **/
-static ht_item* ht_new_item(const char* k, const char* v)
+static inline size_t ht_rh_dist(const ht_hash_table* ht, const uint64_t hash, const size_t index)
 {
-    ht_item* i = malloc(sizeof(ht_item));
-    i->key = strdup(k);
-    i->value = strdup(v);
-    return i;
+    const size_t home = ht_home(ht, hash);
+    return index >= home ? index - home : index + ht->size - home;
 }
 
-
 /**
    #Internal
-   * Create a new Hash Table of a certain size
-   @param int base_size: the initial size
-   @return ht_hash_table the pointer to the new Hash Table
+   * Robin Hood lookup
+   @param size_t* free_slot: if not NULL, set to the slot where key goes:
+                          the first one that is empty or closer to its home
+   @return the index of the slot holding key, or HT_NOT_FOUND
  **/
-
-static ht_hash_table* ht_new_sized(const int base_size)
+static size_t ht_rh_lookup(const ht_hash_table* ht, const uint64_t hash,
+                           const void* key, const size_t len, size_t* free_slot)
 {
-    ht_hash_table* ht = malloc(sizeof(ht_hash_table));
-    if(ht == NULL) return NULL;
-    ht->base_size = base_size;
-    ht->size = next_prime(ht->base_size);
-    ht->count = 0;
-    ht->items = calloc((size_t)ht->size, sizeof(ht_item*));
-    if(ht->items == NULL) return NULL;
+    size_t index = ht_home(ht, hash);
+    for (size_t dist = 0; ; dist++) {
+        const ht_slot* slot = &ht->slots[index];
+        if (slot->hash == HT_HASH_EMPTY ||
+            (slot->hash != HT_HASH_DELETED && ht_rh_dist(ht, slot->hash, index) < dist)) {
+            break;
+        }
+        if (ht_slot_match(ht, slot, hash, key, len)) {
+            return index;
+        }
+        if (++index == ht->size) {
+            index = 0;
+        }
+    }
+    if (free_slot != NULL) {
+        *free_slot = index;
+    }
+    return HT_NOT_FOUND;
+}
 
-    return ht;
+/**
+   #Internal
+   * Put a new entry at the slot found by ht_rh_lookup, pushing the entries
+   * it robs further down the cluster up to the next empty slot
+   @param size_t index: the slot returned in free_slot
+   @param ht_slot* entry: the new entry
+ **/
+static void ht_rh_place(ht_hash_table* ht, size_t index, const ht_slot* entry)
+{
+    ht_slot carry = *entry;
+    size_t dist = ht_rh_dist(ht, carry.hash, index);
+    for (;;) {
+        ht_slot* slot = &ht->slots[index];
+        if (slot->hash == HT_HASH_EMPTY) {
+            *slot = carry;
+            return;
+        }
+        const size_t d = ht_rh_dist(ht, slot->hash, index);
+        if (d < dist) {
+            const ht_slot tmp = *slot;
+            *slot = carry;
+            carry = tmp;
+            dist = d;
+        }
+        if (++index == ht->size) {
+            index = 0;
+        }
+        dist++;
+    }
 }
 
-/** Create a new Hash Table of fixed size **/
-ht_hash_table* ht_new()
+/**
+   #Internal
+   * Empty a slot by shifting back the rest of its cluster
+   * (until an empty slot or an entry already at its home)
+ **/
+static void ht_rh_erase(ht_hash_table* ht, size_t index)
 {
-    return ht_new_sized(HT_INITIAL_BASE_SIZE);
+    size_t next = index + 1 == ht->size ? 0 : index + 1;
+    while (ht->slots[next].hash != HT_HASH_EMPTY &&
+           ht_rh_dist(ht, ht->slots[next].hash, next) > 0) {
+        ht->slots[index] = ht->slots[next];
+        index = next;
+        next = index + 1 == ht->size ? 0 : index + 1;
+    }
+    ht->slots[index].hash = HT_HASH_EMPTY;
 }
 
 
-/******** REMOVE *********/
+/****** LOOKUP ******/
 /**
    #Internal
-   * Given the element, free it
-   @param ht_item: the pointer to existing element
+   * Find key with the probing engine chosen at creation
+   @param size_t* free_slot: if not NULL and key is missing, set to the slot
+                          where key has to be inserted
+   @return the index of the slot holding key, or HT_NOT_FOUND
  **/
-static void ht_del_item(ht_item* i)
+static inline size_t ht_lookup(const ht_hash_table* ht, const uint64_t hash,
+                               const void* key, const size_t len, size_t* free_slot)
 {
-    free(i->key);
-    free(i->value);
-    free(i);
+    if (ht->config.probe == HT_PROBE_GROUP) {
+        return ht_group_lookup(ht, hash, key, len, free_slot);
+    }
+    if (ht->config.probe == HT_PROBE_ROBIN_HOOD) {
+        return ht_rh_lookup(ht, hash, key, len, free_slot);
+    }
+    return ht_double_lookup(ht, hash, key, len, free_slot);
 }
 
-/** Free memory allocated for the Hash Table **/
-void ht_del_hash_table(ht_hash_table* ht)
+/**
+   #Internal
+   * Set the state of a slot, in the control bytes too for the group engine
+ **/
+static inline void ht_slot_set_hash(ht_hash_table* ht, const size_t index, const uint64_t hash)
 {
-    for (int i = 0; i < ht->size; i++) {
-        ht_item* item = ht->items[i];
-        if (item != NULL) {
-            ht_del_item(item);
-        }
+    ht->slots[index].hash = hash;
+    if (ht->ctrl != NULL) {
+        ht->ctrl[index] = hash == HT_HASH_EMPTY ? HT_CTRL_EMPTY
+            : hash == HT_HASH_DELETED ? HT_CTRL_DELETED
+            : ht_ctrl_tag(hash);
     }
-    free(ht->items);
-    free(ht);
 }
 
-
-/****** HASH FUNCTION ******/
 /**
    #Internal
-   * This hash function has two steps:
-   * 1) Convert the string to a large integer
-   * 2) Reduce the size of the integer to a fixed range by taking its remainder mod m
-   *
-   * The variable 'a' should be a prime number larger than the size of the alphabet.
-   * We're hashing ASCII strings, which has an alphabet size of 128,
-   * so we should choose a prime larger than that.
-   @param char* s: the string to be hashed
-   @param int a: the prime integer
-   @param int m: the module (number of buckets)
-   @return the hash number of the string
-**/
-static int ht_hash(const char* s, const int a, const int m)
+   * Move an entry known to be absent into the table, without reading its key.
+   * Used by resize, on the cached hash only.
+   @param ht_slot* entry: the entry, copied as is
+ **/
+static void ht_place(ht_hash_table* ht, const ht_slot* entry)
 {
-    long hash = 0;
-    const int len_s = strlen(s);
-    for (int i = 0; i < len_s; i++) {
-        hash += (long)pow(a, len_s - (i+1)) * s[i];
-        hash = hash % m;
+    size_t index;
+    if (ht->config.probe == HT_PROBE_ROBIN_HOOD) {
+        ht_rh_place(ht, ht_home(ht, entry->hash), entry);
+        return;
     }
-    return (int) hash;
+    if (ht->config.probe == HT_PROBE_GROUP) {
+        ht_group_lookup(ht, entry->hash, NULL, 0, &index);
+    } else {
+        ht_probe probe = ht_probe_start(ht, entry->hash);
+        while (ht->slots[probe.index].hash != HT_HASH_EMPTY) {
+            ht_probe_next(ht, &probe);
+        }
+        index = probe.index;
+    }
+    ht->deleted -= ht->slots[index].hash == HT_HASH_DELETED;
+    ht->slots[index] = *entry;
+    ht_slot_set_hash(ht, index, entry->hash);
 }
 
+
 /**
    #Internal
-   * Double hashing function to handling collitions
-   * pseudo-code: index = (hash_a(string) + i*(hash_b(string) + 1)) % num_buckets
+   * Free the entry at index and mark its slot as free
+   * (Robin Hood: shift its cluster back; an old array being drained
+   * always gets a tombstone, so the migration cursor never misses an entry)
  **/
-static int ht_get_hash(const char* s, const int num_buckets, const int attempt)
+static void ht_erase(ht_hash_table* ht, const size_t index, const int draining)
 {
-    const int hash_a = ht_hash(s, HT_PRIME_1, num_buckets);
-    const int hash_b = ht_hash(s, HT_PRIME_2, num_buckets);
-    return (hash_a + (attempt * (hash_b + 1))) % num_buckets;
+    ht_slot_free(ht, &ht->slots[index]);
+    if (ht->config.probe == HT_PROBE_ROBIN_HOOD && !draining) {
+        ht_rh_erase(ht, index);
+    } else {
+        ht_slot_set_hash(ht, index, HT_HASH_DELETED);
+        ht->deleted++;
+    }
+    ht->count--;
 }
 
 
 /****** INSERT ******/
-void ht_insert(ht_hash_table* ht, const char* key, const char* value)
+/**
+   #Internal
+   * Replace the value of an entry. A copied value of the same length is
+   * overwritten in place, with no free and no new allocation.
+   @return 0, -1 if the new value could not be copied (the old one stays)
+ **/
+static int ht_slot_set_value(ht_hash_table* ht, ht_slot* slot,
+                             const void* value, const size_t vlen)
+{
+    const ht_config* cfg = &ht->config;
+    if (cfg->value_own == HT_OWN_COPY && cfg->value_dup == NULL && cfg->value_free == NULL &&
+        (slot->value_len & ~HT_LEN_INLINE) == vlen && ht_slot_value(slot) != NULL) {
+        memmove(ht_slot_value(slot), value, vlen);
+        return 0;
+    }
+    const ht_slot old = *slot;
+    if (ht_store(ht, cfg->value_own, cfg->value_dup, cfg->value_free,
+                 &slot->value, &slot->value_len, value, vlen, ht_value_inline_max(ht)) != 0) {
+        *slot = old;
+        return -1;
+    }
+    ht_release(ht, cfg->value_own, cfg->value_dup, cfg->value_free, old.value, old.value_len);
+    return 0;
+}
+
+/**
+   #Internal
+   * Find key, or insert it with value: one probe either way.
+   @param uint64_t hash: the key hash (ht_hash), computed once by the caller
+   @param int* inserted: set to 1 if key was inserted, 0 if it was there
+   @return the slot holding key (valid until the next insert or delete),
+           NULL if key is missing and cannot be inserted (out of memory)
+ **/
+static ht_slot* ht_upsert(ht_hash_table* ht, const uint64_t hash,
+                          const void* key, const size_t klen,
+                          const void* value, const size_t vlen, int* inserted)
 {
     /**
        NOTE:
-       To perform the resize, we check the load on the hash table on insert.
-       If it is above predefined limits of 70 (0.7), resize up.
+       To perform the resize, we check the load on the hash table on insert,
+       tombstones included. If it is above config.grow_load (default 70%),
+       resize up; if the entries alone are under 3/4 of it, the slots are
+       mostly tombstones: rehash at the same size instead.
      **/
-    const int load = ht->count * 100 / ht->size;
-    if (load > 70) {
-        ht_resize_up(ht);
+    if ((ht->count + ht->deleted) * 100 > ht->size * ht->config.grow_load) {
+        if (ht->count * 400 <= ht->size * ht->config.grow_load * 3) {
+            if (ht->old != NULL) {
+                ht_migrate(ht, ht->old->size);
+            }
+            ht_purge(ht);
+        } else {
+            ht_resize_up(ht);
+        }
+    } else if (ht->old != NULL) {
+        ht_migrate(ht, HT_MIGRATE_STEP);
+    }
+
+    size_t free_slot = HT_NOT_FOUND;
+    size_t index = ht_lookup(ht, hash, key, klen, &free_slot);
+    if (index != HT_NOT_FOUND) {
+        *inserted = 0;
+        return &ht->slots[index];
+    }
+    if (ht->old != NULL) {
+        // not migrated yet: found where it is
+        index = ht_lookup(ht->old, hash, key, klen, NULL);
+        if (index != HT_NOT_FOUND) {
+            *inserted = 0;
+            return &ht->old->slots[index];
+        }
     }
 
-    // create new element to insert
-    ht_item* item = ht_new_item(key, value);
+    // a grow that ran out of memory left the table as it was: it can fill
+    // past grow_load, but keeps an empty slot for every probe to stop on
+    *inserted = 0;
+    if (ht->count + ht->deleted + 2 > ht->size) {
+        return NULL;
+    }
 
-    // get the first index of bucket and point it
-    int index = ht_get_hash(item->key, ht->size, 0);
-    ht_item* cur_item = ht->items[index];
-
-    int i = 1;
-    // loop untill find a free bucket
-    while (cur_item != NULL) {
-        /**
-           NOTE: If we insert two items with the same key, the keys will collide,
-           and the second item will be inserted into the next available bucket.
-           When searching for the key, the original key will always be found,
-           and we are unable to access the second item.
-        **/
-        if (cur_item != &HT_DELETED_ITEM) {
-            if (strcmp(cur_item->key, key) == 0) {
-                ht_del_item(cur_item);
-                ht->items[index] = item;
-                return;
+    // copies first: if one fails, the table is left as it was
+    ht_slot entry;
+    if (ht_slot_fill(ht, &entry, hash, key, klen, value, vlen) != 0) {
+        return NULL;
+    }
+    *inserted = 1;
+    ht->count++;
+    if (ht->config.probe == HT_PROBE_ROBIN_HOOD) {
+        // the new entry lands at free_slot, the ones it robs move down
+        ht_rh_place(ht, free_slot, &entry);
+    } else {
+        // a tombstone on the probe path is reused
+        ht->deleted -= ht->slots[free_slot].hash == HT_HASH_DELETED;
+        ht->slots[free_slot] = entry;
+        ht_slot_set_hash(ht, free_slot, hash);
+    }
+    return &ht->slots[free_slot];
+}
+
+int ht_insert(ht_hash_table* ht, const void* key, const void* value)
+{
+    return ht_insert_n(ht, key, ht_len(key, ht->config.key_size),
+                value, ht_len(value, ht->config.value_size));
+}
+
+/**
+   #Internal
+   * Insert or replace, the key hash already computed
+ **/
+static int ht_insert_hashed(ht_hash_table* ht, const uint64_t hash,
+                            const void* key, const size_t klen,
+                            const void* value, const size_t vlen)
+{
+    if (klen > HT_LEN_MAX || vlen > HT_LEN_MAX) {
+        return -1;
+    }
+    int inserted;
+    ht_slot* slot = ht_upsert(ht, hash, key, klen, value, vlen, &inserted);
+    if (slot == NULL) {
+        return -1;
+    }
+    if (inserted) {
+        return 0;
+    }
+    // same key: replace the value, the key stays
+    if (ht_slot_set_value(ht, slot, value, vlen) != 0) {
+        return -1;
+    }
+    if (ht->config.key_own == HT_OWN_TAKE) {
+        // the table was given this key and keeps the stored one
+        ht_release(ht, HT_OWN_TAKE, NULL, ht->config.key_free, (void*)key, klen);
+    }
+    return 0;
+}
+
+int ht_insert_n(ht_hash_table* ht, const void* key, const size_t klen,
+                const void* value, const size_t vlen)
+{
+    // hash once, every probe only does integer arithmetic
+    return ht_insert_hashed(ht, ht_hash(ht, key, klen), key, klen, value, vlen);
+}
+
+/**
+   #Internal
+   * Prefetch the home bucket of a hash: its slot, and its group of control
+   * bytes for the group engine. A read prefetch: the write hint needs
+   * PREFETCHW, which baseline x86-64 builds drop silently.
+   * Always inlined: GCC takes a function doing only prefetches for a pure
+   * one and deletes its calls.
+ **/
+static inline __attribute__((always_inline))
+void ht_prefetch_home(const ht_hash_table* ht, const uint64_t hash)
+{
+    const size_t home = ht_home(ht, hash);
+    __builtin_prefetch(&ht->slots[home]);
+    if (ht->ctrl != NULL) {
+        const size_t width = ht_group_width(ht->group_isa);
+        __builtin_prefetch(ht->ctrl + home / width * width);
+    }
+}
+
+int ht_insert_batch(ht_hash_table* ht, const void* const* keys,
+                    const void* const* values, const size_t n)
+{
+    // one resize for the whole batch, done before any hash is reduced
+    // (out of memory: each insert grows the table as it can)
+    ht_reserve(ht, ht->count + n);
+    if (ht->old != NULL) {
+        ht_migrate(ht, ht->old->size);
+    }
+
+    int ret = 0;
+    uint64_t hashes[HT_BATCH];
+    size_t klens[HT_BATCH];
+    for (size_t first = 0; first < n; first += HT_BATCH) {
+        const size_t m = n - first < HT_BATCH ? n - first : HT_BATCH;
+
+        // first pass: hash the block, start fetching the first home buckets
+        for (size_t i = 0; i < m; i++) {
+            klens[i] = ht_len(keys[first + i], ht->config.key_size);
+            hashes[i] = ht_hash(ht, keys[first + i], klens[i]);
+        }
+        for (size_t i = 0; i < m && i < HT_PREFETCH_AHEAD; i++) {
+            ht_prefetch_home(ht, hashes[i]);
+        }
+
+        // second pass: place each key while the buckets ahead are on their way
+        for (size_t i = 0; i < m; i++) {
+            if (i + HT_PREFETCH_AHEAD < m) {
+                ht_prefetch_home(ht, hashes[i + HT_PREFETCH_AHEAD]);
+            }
+            const void* value = values[first + i];
+            if (ht_insert_hashed(ht, hashes[i], keys[first + i], klens[i],
+                                 value, ht_len(value, ht->config.value_size)) != 0) {
+                ret = -1;
             }
         }
-        index = ht_get_hash(item->key, ht->size, i);
-        cur_item = ht->items[index];
-        i++;
     }
-    ht->items[index] = item;
-    ht->count++;
+    return ret;
+}
+
+void* ht_find_or_insert(ht_hash_table* ht, const void* key, const void* value, int* inserted)
+{
+    return ht_find_or_insert_n(ht, key, ht_len(key, ht->config.key_size),
+                               value, ht_len(value, ht->config.value_size), inserted);
+}
+
+void* ht_find_or_insert_n(ht_hash_table* ht, const void* key, const size_t klen,
+                          const void* value, const size_t vlen, int* inserted)
+{
+    int is_new = 0;
+    ht_slot* slot = NULL;
+    if (klen <= HT_LEN_MAX && vlen <= HT_LEN_MAX) {
+        slot = ht_upsert(ht, ht_hash(ht, key, klen), key, klen, value, vlen, &is_new);
+    }
+    if (inserted != NULL) {
+        *inserted = is_new;
+    }
+    if (slot == NULL) {
+        return NULL;
+    }
+    if (!is_new) {
+        // found: the table was given key and value and keeps the stored ones
+        const ht_config* cfg = &ht->config;
+        if (cfg->key_own == HT_OWN_TAKE) {
+            ht_release(ht, HT_OWN_TAKE, NULL, cfg->key_free, (void*)key, klen);
+        }
+        if (cfg->value_own == HT_OWN_TAKE) {
+            ht_release(ht, HT_OWN_TAKE, NULL, cfg->value_free, (void*)value, vlen);
+        }
+    }
+    return ht_slot_value(slot);
+}
+
+
+/****** UPDATE ******/
+int ht_update(ht_hash_table* ht, const void* key, const void* value)
+{
+    return ht_update_n(ht, key, ht_len(key, ht->config.key_size),
+                       value, ht_len(value, ht->config.value_size));
+}
+
+int ht_update_n(ht_hash_table* ht, const void* key, const size_t klen,
+                const void* value, const size_t vlen)
+{
+    if (klen > HT_LEN_MAX || vlen > HT_LEN_MAX) {
+        return -1;
+    }
+    if (ht->old != NULL) {
+        ht_migrate(ht, HT_MIGRATE_STEP);
+    }
+
+    const uint64_t hash = ht_hash(ht, key, klen);
+
+    ht_slot* slot = NULL;
+    size_t index = ht_lookup(ht, hash, key, klen, NULL);
+    if (index != HT_NOT_FOUND) {
+        slot = &ht->slots[index];
+    } else if (ht->old != NULL &&
+               (index = ht_lookup(ht->old, hash, key, klen, NULL)) != HT_NOT_FOUND) {
+        slot = &ht->old->slots[index];
+    } else {
+        return 0;
+    }
+    return ht_slot_set_value(ht, slot, value, vlen) == 0 ? 1 : -1;
 }
 
 
 /****** SEARCH ******/
-char* ht_search(ht_hash_table* ht, const char* key)
+void* ht_search(ht_hash_table* ht, const void* key)
 {
-    // get the first index of bucket and point it
-    int index = ht_get_hash(key, ht->size, 0);
-    ht_item* item = ht->items[index];
+    return ht_search_n(ht, key, ht_len(key, ht->config.key_size));
+}
 
-    int i = 1;
-    // loop untill elements exist
-    while (item != NULL) {
-        // if the element is not set as deleted and key match,
-        // return the associated value
-        if (item != &HT_DELETED_ITEM) {
-            if (strcmp(item->key, key) == 0) {
-                return item->value;
-            }
+void* ht_search_n(ht_hash_table* ht, const void* key, const size_t len)
+{
+    if (ht->old != NULL) {
+        ht_migrate(ht, HT_MIGRATE_STEP);
+    }
+
+    const uint64_t hash = ht_hash(ht, key, len);
+
+    size_t index = ht_lookup(ht, hash, key, len, NULL);
+    if (index != HT_NOT_FOUND) {
+        return ht_slot_value(&ht->slots[index]);
+    }
+    if (ht->old != NULL) {
+        index = ht_lookup(ht->old, hash, key, len, NULL);
+        if (index != HT_NOT_FOUND) {
+            return ht_slot_value(&ht->old->slots[index]);
         }
-        // else, go ahead
-        index = ht_get_hash(key, ht->size, i);
-        item = ht->items[index];
-        i++;
     }
     return NULL;
 }
 
+/**
+   #Internal
+   * Value of key in the old array of a running resize, NULL if not there
+ **/
+static inline void* ht_search_old(const ht_hash_table* ht, const uint64_t hash,
+                                  const void* key, const size_t len)
+{
+    if (ht->old == NULL) {
+        return NULL;
+    }
+    const size_t index = ht_lookup(ht->old, hash, key, len, NULL);
+    return index != HT_NOT_FOUND ? ht_slot_value(&ht->old->slots[index]) : NULL;
+}
+
+/**
+   #Internal
+   * A lookup in flight of ht_search_batch (double hashing engine)
+ **/
+typedef struct {
+    int state;           // HT_AMAC_*
+    size_t key;          // index of the key in the batch
+    size_t len;
+    uint64_t hash;
+    ht_probe probe;      // the slot being looked at
+} ht_amac_lane;
 
-/****** DELETE ******/
-void ht_delete(ht_hash_table* ht, const char* key)
+/**
+   #Internal
+   * Give a lane the next key of the batch: hash it, prefetch its home slot.
+   * No key left: the lane is done.
+   @return 1 if the lane got a key
+ **/
+static inline int ht_amac_start(const ht_hash_table* ht, ht_amac_lane* lane,
+                                const void* const* keys, const size_t n, size_t* next)
 {
-    /**
-       NOTE:
-       To perform the resize, we check the load on the hash table on delete.
-       If it is below predefined limits of 10 (0.1), resize down.
-    **/
-    const int load = ht->count * 100 / ht->size;
-    if (load < 10) {
-        ht_resize_down(ht);
+    if (*next == n) {
+        lane->state = HT_AMAC_DONE;
+        return 0;
     }
+    lane->key = (*next)++;
+    lane->len = ht_len(keys[lane->key], ht->config.key_size);
+    lane->hash = ht_hash(ht, keys[lane->key], lane->len);
+    lane->probe = ht_probe_start(ht, lane->hash);
+    lane->state = HT_AMAC_PROBE;
+    __builtin_prefetch(&ht->slots[lane->probe.index]);
+    return 1;
+}
 
-    // get the first index of bucket and point it
-    int index = ht_get_hash(key, ht->size, 0);
-    ht_item* item = ht->items[index];
+/**
+   #Internal
+   * Double hashing batch lookup, as an AMAC state machine (Kocberber et al.,
+   * "Asynchronous Memory Access Chaining"): HT_PREFETCH_AHEAD lookups are in
+   * flight, and each step of a lookup only touches memory prefetched by its
+   * previous step, then issues the prefetch of its next one and yields to the
+   * next lane. A lookup whose slot holds the same hash fetches the stored key
+   * before comparing it, unless the key is inline. The misses of the lanes
+   * overlap instead of chaining one after the other.
+ **/
+static void ht_search_batch_double(ht_hash_table* ht, const void* const* keys,
+                                   void** values, const size_t n)
+{
+    ht_amac_lane lanes[HT_PREFETCH_AHEAD];
+    size_t next = 0;
+    size_t active = 0;
+    for (size_t l = 0; l < HT_PREFETCH_AHEAD; l++) {
+        active += ht_amac_start(ht, &lanes[l], keys, n, &next);
+    }
 
-    int i = 1;
-    // loop untill elements exist
-    while (item != NULL) {
-        // if element exists and it's not already deleted, set pos as deleted
-        if (item != &HT_DELETED_ITEM) {
-            if (strcmp(item->key, key) == 0) {
-                ht_del_item(item);
-                ht->items[index] = &HT_DELETED_ITEM;
+    for (size_t l = 0; active > 0; l = l + 1 == HT_PREFETCH_AHEAD ? 0 : l + 1) {
+        ht_amac_lane* lane = &lanes[l];
+        if (lane->state == HT_AMAC_DONE) {
+            continue;
+        }
+        const ht_slot* slot = &ht->slots[lane->probe.index];
+        const void* key = keys[lane->key];
+        void* found = NULL;
+        int resolved = 0;
+
+        if (lane->state == HT_AMAC_COMPARE) {
+            if (ht_slot_match(ht, slot, lane->hash, key, lane->len)) {
+                found = ht_slot_value(slot);
+                resolved = 1;
             }
+        } else if (slot->hash == HT_HASH_EMPTY) {
+            // not here: not migrated yet, or missing
+            found = ht_search_old(ht, lane->hash, key, lane->len);
+            resolved = 1;
+        } else if (slot->hash == lane->hash) {
+            if (!(slot->key_len & HT_LEN_INLINE)) {
+                __builtin_prefetch(slot->key);
+                lane->state = HT_AMAC_COMPARE;
+                continue;
+            }
+            if (ht_slot_match(ht, slot, lane->hash, key, lane->len)) {
+                found = ht_slot_value(slot);
+                resolved = 1;
+            }
+        }
+
+        if (resolved) {
+            values[lane->key] = found;
+            if (!ht_amac_start(ht, lane, keys, n, &next)) {
+                active--;
+            }
+        } else {
+            // deleted slot, other key, or a hash collision: next slot of the probe
+            ht_probe_next(ht, &lane->probe);
+            lane->state = HT_AMAC_PROBE;
+            __builtin_prefetch(&ht->slots[lane->probe.index]);
         }
-        index = ht_get_hash(key, ht->size, i);
-        item = ht->items[index];
-        i++;
     }
-    ht->count--;
+}
+
+void ht_search_batch(ht_hash_table* ht, const void* const* keys,
+                     void** values, const size_t n)
+{
+    if (ht->old != NULL) {
+        ht_migrate(ht, HT_MIGRATE_STEP);
+    }
+    if (ht->config.probe == HT_PROBE_DOUBLE) {
+        ht_search_batch_double(ht, keys, values, n);
+        return;
+    }
+
+    // group and Robin Hood engines: a lookup rarely leaves the lines of its
+    // home bucket, so prefetching them a few keys ahead is enough
+    uint64_t hashes[HT_BATCH];
+    size_t klens[HT_BATCH];
+    for (size_t first = 0; first < n; first += HT_BATCH) {
+        const size_t m = n - first < HT_BATCH ? n - first : HT_BATCH;
+        for (size_t i = 0; i < m; i++) {
+            klens[i] = ht_len(keys[first + i], ht->config.key_size);
+            hashes[i] = ht_hash(ht, keys[first + i], klens[i]);
+        }
+        for (size_t i = 0; i < m && i < HT_PREFETCH_AHEAD; i++) {
+            ht_prefetch_home(ht, hashes[i]);
+        }
+        for (size_t i = 0; i < m; i++) {
+            if (i + HT_PREFETCH_AHEAD < m) {
+                ht_prefetch_home(ht, hashes[i + HT_PREFETCH_AHEAD]);
+            }
+            const void* key = keys[first + i];
+            const size_t index = ht_lookup(ht, hashes[i], key, klens[i], NULL);
+            values[first + i] = index != HT_NOT_FOUND ? ht_slot_value(&ht->slots[index])
+                : ht_search_old(ht, hashes[i], key, klens[i]);
+        }
+    }
+}
+
+
+/****** DELETE ******/
+void ht_delete(ht_hash_table* ht, const void* key)
+{
+    ht_delete_n(ht, key, ht_len(key, ht->config.key_size));
+}
+
+void ht_delete_n(ht_hash_table* ht, const void* key, const size_t len)
+{
+    if (ht->old != NULL) {
+        ht_migrate(ht, HT_MIGRATE_STEP);
+    }
+
+    const uint64_t hash = ht_hash(ht, key, len);
+
+    // if element exists, set pos as deleted (Robin Hood: shift its cluster back)
+    size_t index = ht_lookup(ht, hash, key, len, NULL);
+    if (index != HT_NOT_FOUND) {
+        ht_erase(ht, index, 0);
+    } else if (ht->old != NULL &&
+               (index = ht_lookup(ht->old, hash, key, len, NULL)) != HT_NOT_FOUND) {
+        ht_erase(ht->old, index, 1);
+        ht->count--;
+    } else {
+        return;
+    }
+
+    /**
+       NOTE:
+       To perform the resize, we check the load on the hash table after a delete.
+       If it is below config.shrink_load (default 10%, 0 never), resize down.
+    **/
+    if (ht->count * 100 < ht->size * ht->config.shrink_load) {
+        ht_resize_down(ht);
+    }
 }
 
 
 /****** RESIZE ******/
 /**
    #Internal
-   * Resize the Hash Table by the new size number
+   * Resize the Hash Table by the new size number.
+   * The new (empty) slot array replaces the current one, which is kept aside
+   * in ht->old and drained into the new one by ht_migrate: all at once, or,
+   * with config.incremental_resize, HT_MIGRATE_STEP buckets per operation,
+   * lookups consulting both arrays meanwhile.
    @param ht: the Hash Table to resize
    @param base size: the new dimension
+   @return 0, -1 if out of memory (the table keeps its current slots)
  **/
-static void ht_resize(ht_hash_table* ht, const int base_size)
+static int ht_resize(ht_hash_table* ht, const size_t base_size)
 {
     if(base_size < HT_INITIAL_BASE_SIZE) {
-        return;
+        return 0;
     }
 
-    // new Hash Table used as temporary
-    ht_hash_table* new_ht = ht_new_sized(base_size);
+    // one resize at a time: finish the running one
+    if (ht->old != NULL) {
+        ht_migrate(ht, ht->old->size);
+    }
 
-    for (int i = 0; i < ht->size; i++) {
-        ht_item* item = ht->items[i];
-        if (item != NULL && item != &HT_DELETED_ITEM) {
-            ht_insert(new_ht, item->key, item->value);
-        }
+    // new Hash Table used as temporary
+    ht_hash_table* new_ht = ht_new_sized(base_size, &ht->config);
+    if (new_ht == NULL) {
+        return -1;
     }
 
     ht->base_size = new_ht->base_size;
-    ht->count = new_ht->count;
 
-    // To delete new_ht, we give it ht's size and items
-    const int tmp_size = ht->size;
+    // we give new_ht ht's size and slots: it becomes the old array
+    const size_t tmp_size = ht->size;
     ht->size = new_ht->size;
     new_ht->size = tmp_size;
 
-    ht_item** tmp_items = ht->items;
-    ht->items = new_ht->items;
-    new_ht->items = tmp_items;
+    const unsigned tmp_shift = ht->shift;
+    ht->shift = new_ht->shift;
+    new_ht->shift = tmp_shift;
+
+    const prime_size* tmp_prime = ht->prime;
+    ht->prime = new_ht->prime;
+    new_ht->prime = tmp_prime;
+
+    ht_slot* tmp_slots = ht->slots;
+    ht->slots = new_ht->slots;
+    new_ht->slots = tmp_slots;
+
+    uint8_t* tmp_ctrl = ht->ctrl;
+    ht->ctrl = new_ht->ctrl;
+    new_ht->ctrl = tmp_ctrl;
+
+    new_ht->count = ht->count;
+    new_ht->deleted = ht->deleted;
+    ht->deleted = 0;
+    new_ht->arena = ht->arena;
+    ht->old = new_ht;
+    ht->migrate_pos = 0;
+
+    if (!ht->config.incremental_resize) {
+        ht_migrate(ht, ht->old->size);
+    }
+    return 0;
+}
+
+/**
+   #Internal
+   * Move the entries of the next old buckets into the current array.
+   * Slots are moved: keys and values stay where they are, no key is read again.
+   * A moved slot is left as a tombstone so the old probe chains stay intact
+   * for lookups until the old array is gone.
+   @param ht: the Hash Table being resized
+   @param buckets: the number of old buckets to visit
+ **/
+static void ht_migrate(ht_hash_table* ht, size_t buckets)
+{
+    ht_hash_table* old = ht->old;
+    for (; buckets > 0 && ht->migrate_pos < old->size && old->count > 0; buckets--) {
+        const size_t i = ht->migrate_pos++;
+        const ht_slot* slot = &old->slots[i];
+        if (slot->hash != HT_HASH_EMPTY && slot->hash != HT_HASH_DELETED) {
+            ht_place(ht, slot);
+            ht_slot_set_hash(old, i, HT_HASH_DELETED);
+            old->count--;
+        }
+    }
+    // every entry moved: free the arrays only
+    if (ht->migrate_pos == old->size || old->count == 0) {
+        ht_mfree(ht, old->slots);
+        ht_mfree(ht, old->ctrl);
+        ht_mfree(ht, old);
+        ht->old = NULL;
+    }
+}
+
+/**
+   #Internal
+   * Purge tombstones: rehash at the same size, in place.
+   * Deleted slots become empty, then every entry is marked pending (bitmap;
+   * group engine: control byte HT_CTRL_DELETED, so the free-slot search
+   * sees it) and moved to the first empty or pending slot of its probe path,
+   * swapping with a pending entry found there, which is then placed in turn.
+   * No slot array is allocated, only size/8 bytes of bitmap.
+ **/
+static inline int ht_pending(const uint64_t* pending, const size_t i)
+{
+    return (int)((pending[i / 64] >> (i % 64)) & 1);
+}
+
+static size_t ht_purge_target(const ht_hash_table* ht, const uint64_t hash,
+                              const uint64_t* pending)
+{
+    size_t index;
+    if (ht->ctrl != NULL) {
+        ht_group_lookup(ht, hash, NULL, 0, &index);
+        return index;
+    }
+    ht_probe probe = ht_probe_start(ht, hash);
+    while (ht->slots[probe.index].hash != HT_HASH_EMPTY && !ht_pending(pending, probe.index)) {
+        ht_probe_next(ht, &probe);
+    }
+    return probe.index;
+}
+
+static void ht_purge(ht_hash_table* ht)
+{
+    const ht_allocator* a = ht->config.allocator;
+    uint64_t* pending = a->alloc_zeroed(a->ctx, (ht->size + 63) / 64, sizeof(uint64_t));
+    if (pending == NULL) return;
+
+    for (size_t i = 0; i < ht->size; i++) {
+        const uint64_t hash = ht->slots[i].hash;
+        if (hash == HT_HASH_DELETED) {
+            ht_slot_set_hash(ht, i, HT_HASH_EMPTY);
+        } else if (hash != HT_HASH_EMPTY) {
+            pending[i / 64] |= 1ULL << (i % 64);
+            if (ht->ctrl != NULL) {
+                ht->ctrl[i] = HT_CTRL_DELETED;
+            }
+        }
+    }
+    ht->deleted = 0;
 
-    // now new_ht point to old items, so delete it
-    ht_del_hash_table(new_ht);
+    for (size_t i = 0; i < ht->size; i++) {
+        while (ht_pending(pending, i)) {
+            const uint64_t hash = ht->slots[i].hash;
+            const size_t target = ht_purge_target(ht, hash, pending);
+            pending[target / 64] &= ~(1ULL << (target % 64));
+            if (target == i) {
+                ht_slot_set_hash(ht, i, hash);
+            } else if (ht->slots[target].hash == HT_HASH_EMPTY) {
+                ht->slots[target] = ht->slots[i];
+                ht_slot_set_hash(ht, target, hash);
+                ht_slot_set_hash(ht, i, HT_HASH_EMPTY);
+                pending[i / 64] &= ~(1ULL << (i % 64));
+            } else {
+                // a pending entry: swapped, and slot i is handled again
+                const ht_slot tmp = ht->slots[target];
+                ht->slots[target] = ht->slots[i];
+                ht->slots[i] = tmp;
+                ht_slot_set_hash(ht, target, hash);
+            }
+        }
+    }
+    a->free(a->ctx, pending);
 }
 
 /**
    #Internal
-   * Resize UP. We need more space
+   * Resize UP. We need more space: the size over the current slot count
+   * (twice it, or the next tabulated prime, about twice it)
  **/
-static void ht_resize_up(ht_hash_table* ht)
+static int ht_resize_up(ht_hash_table* ht)
 {
-    const int new_size = ht->base_size * 2;
-    ht_resize(ht, new_size);
+    const size_t new_size = ht->config.sizing == HT_SIZE_POW2 ?
+        ht->size * 2 : next_prime_size(ht->size + 1)->p;
+    if (new_size <= ht->size) {
+        return -1;
+    }
+    return ht_resize(ht, new_size);
 }
 
 /**
    #Internal
-   * Resize DOWN. We need less space
+   * Resize DOWN. We need less space, down to room for config.min_capacity.
+   * The new size is the one under the current slot count (half of it, or the
+   * previous tabulated prime): kept only if it holds the entries at least
+   * HT_LOAD_BAND points under the grow threshold, else the table stays as it is.
  **/
 
 static void ht_resize_down(ht_hash_table* ht)
 {
-    const int new_size = ht->base_size / 2;
-    ht_resize(ht, new_size);
+    const size_t floor = ht_capacity_base(ht->config.grow_load, ht->config.min_capacity);
+    const size_t new_size = ht->config.sizing == HT_SIZE_POW2 ?
+        ht->size / 2 : prev_prime_size(ht->size)->p;
+    if (new_size < ht->size && new_size >= floor &&
+        ht->config.grow_load > HT_LOAD_BAND &&
+        ht->count * 100 <= new_size * (ht->config.grow_load - HT_LOAD_BAND)) {
+        ht_resize(ht, new_size);
+    }
 }
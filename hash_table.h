@@ -2,37 +2,204 @@
    Generic implementation of Hash Table in C
 **/
 
- #include <stdio.h>
- #include <stdlib.h
+#ifndef HASH_TABLE_H
+#define HASH_TABLE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "prime.h"
 
 #define HT_INITIAL_BASE_SIZE 50
-#define HT_PRIME_1           131
-#define HT_PRIME_2           151
+#define HT_DEFAULT_SEED      0x9e3779b97f4a7c15ULL
+#define HT_DEFAULT_GROW_LOAD   70
+#define HT_DEFAULT_SHRINK_LOAD 10
+
+/* 2^64 / golden ratio: multiplier of the power-of-two index reduction */
+#define HT_FIBONACCI 11400714819323198485ULL
+
+
+/**
+   Hash function: map len bytes starting at key to a 64-bit value
+   @param void* key: the bytes to be hashed
+   @param size_t len: the number of bytes
+   @param uint64_t seed: the per-table seed
+   @return the 64-bit hash
+ **/
+typedef uint64_t (*ht_hash_fn)(const void* key, size_t len, uint64_t seed);
+
+/**
+   Key equality, called only for keys with the same hash
+   @param void* a, size_t a_len: a stored key
+   @param void* b, size_t b_len: the key looked for
+   @return non zero if the keys are equal
+ **/
+typedef int (*ht_eq_fn)(const void* a, size_t a_len, const void* b, size_t b_len);
+
+/**
+   Ownership callbacks: dup makes the copy kept by the table, free releases it
+ **/
+typedef void* (*ht_dup_fn)(const void* p, size_t len);
+typedef void (*ht_free_fn)(void* p);
+
+
+/* Tag of a slot length: the bytes are in the slot itself (key_bytes, value_bytes) */
+#define HT_LEN_INLINE 0x80000000u
+
+/* Longest key or value: the lengths of a slot keep their top bit for HT_LEN_INLINE */
+#define HT_LEN_MAX 0x7fffffffu
+
+/* Longest key or value copied into the slot, its terminator included in the field */
+#define HT_INLINE_MAX (sizeof(void*) - 1)
+
+/* Widest value of a config.inline_values table: the whole field, no terminator */
+#define HT_INLINE_VALUE_MAX sizeof(void*)
 
 
-// Items
+// Slot: cached hash with inline key/value descriptors
 typedef struct {
-    char* key;
-    char* value;
-} ht_item;
+    uint64_t hash;       // key hash, or the empty/deleted state
+    union {
+        void* key;
+        char key_bytes[sizeof(void*)];   // HT_LEN_INLINE: the key, NUL-terminated
+    };
+    union {
+        void* value;
+        char value_bytes[sizeof(void*)]; // HT_LEN_INLINE: the value (NUL-terminated if shorter)
+    };
+    uint32_t key_len;    // length, HT_LEN_INLINE set if stored in key_bytes
+    uint32_t value_len;  // length, HT_LEN_INLINE set if stored in value_bytes
+} ht_slot;
 
 
-// Hash Table
+// Probing engines
+typedef enum {
+    HT_PROBE_DOUBLE = 0,   // double hashing over the slot array
+    HT_PROBE_GROUP,        // SwissTable-style control bytes, matched 16/32 at a time
+    HT_PROBE_ROBIN_HOOD    // linear Robin Hood, backward-shift delete (no tombstones)
+} ht_probe_mode;
+
+
+// Bucket counts
+typedef enum {
+    HT_SIZE_PRIME = 0,     // prime sizes, index = hash % size by multiplies (fastmod)
+    HT_SIZE_POW2           // power-of-two sizes, multiply-shift index, no division
+} ht_size_mode;
+
+
+/**
+   Allocator of a table: every allocation of the table goes through it
+   (table, slot arrays, copies of keys and values, arena chunks)
+ **/
+typedef struct ht_allocator {
+    void* (*alloc)(void* ctx, size_t size);                  // like malloc
+    void* (*alloc_zeroed)(void* ctx, size_t count, size_t size); // like calloc
+    void (*free)(void* ctx, void* p);                        // like free
+    void* ctx;                                               // passed to the three
+} ht_allocator;
+
+
+// Ownership of the keys and values passed to insert
+typedef enum {
+    HT_OWN_COPY = 0,       // the table stores a copy (dup callback), frees it (free callback)
+    HT_OWN_BORROW,         // the table stores the pointer, the caller keeps it alive and frees it
+    HT_OWN_TAKE            // the table stores the pointer and frees it (free callback)
+} ht_ownership;
+
+
+// Options chosen at creation
 typedef struct {
-    int base_size;
-    int size;
-    int count;
-    ht_item** items;
+    ht_hash_fn hash;       // hash kernel (default: ht_hash_wyhash)
+    uint64_t seed;         // seed passed to the hash kernel
+    ht_probe_mode probe;   // probing engine (default: HT_PROBE_DOUBLE)
+    int incremental_resize; // spread each resize over the next operations (default: 0)
+    ht_size_mode sizing;   // bucket counts (default: HT_SIZE_PRIME)
+    size_t key_size;       // bytes of a key, 0 for NUL-terminated strings (default: 0)
+    size_t value_size;     // bytes of a value, 0 for NUL-terminated strings (default: 0)
+    ht_eq_fn key_eq;       // key equality (default: NULL, same length and bytes)
+    ht_ownership key_own;  // what insert does with a key (default: HT_OWN_COPY)
+    ht_ownership value_own; // what insert does with a value (default: HT_OWN_COPY)
+    ht_dup_fn key_dup;     // HT_OWN_COPY: stored copy of a key (default: NULL, allocator copy)
+    ht_free_fn key_free;   // COPY/TAKE: releases a stored key (default: NULL, allocator free)
+    ht_dup_fn value_dup;   // HT_OWN_COPY: stored copy of a value (default: NULL, allocator copy)
+    ht_free_fn value_free; // COPY/TAKE: releases a stored value (default: NULL, allocator free)
+    int arena;             // copies of keys and values in a table arena (default: 0)
+    const ht_allocator* allocator; // memory of the table (default: NULL, malloc/calloc/free)
+    unsigned grow_load;    // % load over which insert grows the table (default: 70, at most 95)
+    unsigned shrink_load;  // % load under which delete shrinks it, 0 never (default: 10;
+                           // lowered if needed, so a shrink lands 10 points under grow_load)
+    size_t min_capacity;   // entries the table always has room for (default: 0)
+    int inline_values;     // fixed-width values of value_size bytes (at most 8), copied
+                           // into the slot with no terminator; ignored for string values
+                           // and with value dup/free callbacks or ownership (default: 0)
+} ht_config;
+
+
+// Hash Table
+typedef struct ht_hash_table {
+    size_t base_size;
+    size_t size;
+    size_t count;
+    size_t deleted;        // tombstones, reused by insert and purged by an in-place rehash
+    unsigned shift;        // HT_SIZE_POW2: 64 - log2(size)
+    const prime_size* prime; // HT_SIZE_PRIME: size and its fastmod constant
+    ht_config config;
+    ht_slot* slots;
+    uint8_t* ctrl;         // HT_PROBE_GROUP: one control byte per slot
+    int group_isa;         // HT_PROBE_GROUP: group matcher picked by the CPU check
+    struct ht_hash_table* old; // resize in progress: the slots still to migrate
+    size_t migrate_pos;    // resize in progress: next old bucket to migrate
+    struct ht_arena* arena; // config.arena: holds the copied keys and values
 } ht_hash_table;
 
 
 
+/**
+   wyhash-style 64-bit hash: one pass over the key, 16 bytes per round
+ **/
+uint64_t ht_hash_wyhash(const void* key, size_t len, uint64_t seed);
+
+/**
+   FNV-1a 64-bit hash: byte at a time, kept as a simple alternative
+ **/
+uint64_t ht_hash_fnv1a(const void* key, size_t len, uint64_t seed);
+
+/**
+   Fill a config with the default options
+   @param ht_config* cfg: the config to initialize
+ **/
+void ht_config_init(ht_config* cfg);
+
 /**
    Create a new Hash Table of fixed size
    @return ht_hash_table Hash Table
  **/
 ht_hash_table* ht_new();
 
+/**
+   Create a new Hash Table with the given options
+   @param ht_config* cfg: the options (NULL for defaults)
+   @return ht_hash_table Hash Table
+ **/
+ht_hash_table* ht_new_ex(const ht_config* cfg);
+
+/**
+   Create a new Hash Table with room for capacity entries:
+   inserting up to capacity entries never resizes it
+   @param size_t capacity: the number of entries expected
+   @return ht_hash_table Hash Table
+ **/
+ht_hash_table* ht_new_with_capacity(size_t capacity);
+
+/**
+   Grow the Hash Table so that it holds capacity entries without resizing
+   (one resize now, none while they are inserted). Never shrinks it.
+   @param ht_hash_table* ht: the Hash Table
+   @param size_t capacity: the number of entries expected
+   @return 0, -1 if out of memory (the table is left as it was)
+ **/
+int ht_reserve(ht_hash_table* ht, size_t capacity);
+
 /**
    Free memory allocated for the Hash Table
    @param ht_hash_table: the pointer to the HT
@@ -41,27 +208,146 @@ void ht_del_hash_table(ht_hash_table* ht);
 
 /**
    Insert a new key-value pair element in the Hash Table
+   Keys and values are strings, or config.key_size / config.value_size bytes.
+   By default the table stores its own copies; with config.key_own /
+   config.value_own it can store the given pointers instead (borrow or take).
+   Copies of up to HT_INLINE_MAX bytes made without dup/free callbacks are
+   kept in the slot itself: no allocation, no pointer to follow.
+   HT_OWN_TAKE: a key already in the table is released at once, the stored
+   one stays.
+   Out of memory, a grow is skipped and the table fills past its grow
+   threshold; a new key is refused only when no free slot is left.
+   @param ht_hash_table* ht: the Hash Table
+   @param void* key: the key
+   @param void* value: the value
+   @return 0, -1 if the pair was not stored (out of memory): the caller
+           keeps key and value, whatever the ownership policy
+ **/
+int ht_insert(ht_hash_table* ht, const void* key, const void* value);
+
+/**
+   Insert a key-value pair given as (pointer, length) slices: key and value
+   need no terminator and may contain NUL bytes. The stored copies are
+   NUL-terminated. A key or value longer than HT_LEN_MAX is refused.
+   @param ht_hash_table* ht: the Hash Table
+   @param void* key: the key bytes
+   @param size_t klen: the key length
+   @param void* value: the value bytes
+   @param size_t vlen: the value length
+   @return 0, -1 if the pair was not stored (out of memory, or a length
+           above HT_LEN_MAX)
+ **/
+int ht_insert_n(ht_hash_table* ht, const void* key, size_t klen,
+                const void* value, size_t vlen);
+
+/**
+   Insert n key-value pairs, as n calls to ht_insert would (a key given
+   twice keeps the last value), for bulk loads:
+   the table is grown once for count + n entries, the keys are hashed
+   ahead in blocks, and the home bucket of each key is prefetched a few
+   keys before it is placed, so the cache misses of the batch overlap.
    @param ht_hash_table* ht: the Hash Table
-   @param char* key: the key
-   @param char* value: the value
+   @param void** keys: the keys
+   @param void** values: the values, values[i] for keys[i]
+   @param size_t n: the number of pairs
+   @return 0, -1 if some pairs were not stored (as ht_insert)
  **/
-void ht_insert(ht_hash_table* ht, const char* key, const char* value);
+int ht_insert_batch(ht_hash_table* ht, const void* const* keys,
+                    const void* const* values, size_t n);
+
+/**
+   Find key, or insert it with value if missing: one hash and one probe,
+   for read-modify-write paths (e.g. counters with value_size set)
+   HT_OWN_TAKE: if key is found, the key and value given are released at
+   once (the stored ones stay); if NULL is returned, the caller keeps them.
+   @param ht_hash_table* ht: the Hash Table
+   @param void* key: the key
+   @param void* value: the value stored if key is inserted
+   @param int* inserted: if not NULL, set to 1 if key was inserted, 0 if found
+   @return the stored value, which can be modified in place;
+           NULL if key was missing and could not be inserted (out of memory).
+           A value kept in its slot (HT_INLINE_MAX bytes or less, or
+           config.inline_values) moves with it: the pointer is valid until
+           the next call on the table.
+ **/
+void* ht_find_or_insert(ht_hash_table* ht, const void* key, const void* value, int* inserted);
+
+/**
+   ht_find_or_insert with (pointer, length) key and value
+   (NULL for a length above HT_LEN_MAX)
+ **/
+void* ht_find_or_insert_n(ht_hash_table* ht, const void* key, size_t klen,
+                          const void* value, size_t vlen, int* inserted);
+
+/**
+   Replace the value of an existing key; a copied value of the same length
+   is overwritten in place, without freeing and allocating it again
+   @param ht_hash_table* ht: the Hash Table
+   @param void* key: the key
+   @param void* value: the new value
+   @return 1 if key was found and updated, 0 if missing (nothing inserted),
+           -1 if the new value could not be copied (the old one stays)
+ **/
+int ht_update(ht_hash_table* ht, const void* key, const void* value);
+
+/**
+   ht_update with (pointer, length) key and value
+   (-1 for a length above HT_LEN_MAX)
+ **/
+int ht_update_n(ht_hash_table* ht, const void* key, size_t klen,
+                const void* value, size_t vlen);
 
 /**
    Search an element by its key in the Hash Table
    @param ht_hash_table* ht: the Hash Table
-   @param char* key: the key
-   @param char* value: the value
-   @return the item value associated to key
+   @param void* key: the key
+   @return the stored value associated to key, NULL if missing.
+           A value kept in its slot (HT_INLINE_MAX bytes or less, or
+           config.inline_values) moves with it: the pointer is valid until
+           the next call on the table.
  **/
-char* ht_search(ht_hash_table* ht, const char* key);
+void* ht_search(ht_hash_table* ht, const void* key);
+
+/**
+   Search an element by a (pointer, length) key, e.g. a slice of a buffer
+   @param ht_hash_table* ht: the Hash Table
+   @param void* key: the key bytes
+   @param size_t len: the key length
+   @return the stored value associated to key, NULL if missing
+ **/
+void* ht_search_n(ht_hash_table* ht, const void* key, size_t len);
+
+/**
+   Search n keys at once: values[i] is set to ht_search(ht, keys[i]).
+   For batches of tens to hundreds of keys in tables much larger than the
+   cache: the lookups are interleaved and their buckets prefetched ahead,
+   so their cache misses overlap instead of coming one after the other.
+   @param ht_hash_table* ht: the Hash Table
+   @param void** keys: the keys
+   @param void** values: n results, NULL for a missing key
+   @param size_t n: the number of keys
+ **/
+void ht_search_batch(ht_hash_table* ht, const void* const* keys,
+                     void** values, size_t n);
 
 /**
    Delete an element searching by its key in the Hash Table
    NOTE: because of double hashing for handling collision,
          instead of deleting the item, it simply mark it as deleted.
+         Deleted slots are counted, reused by insert, and purged by a
+         same-size rehash once they fill the table.
+         HT_PROBE_ROBIN_HOOD tables shift the following items back instead.
    @param ht_hash_table* ht: the Hash Table
-   @param char* key: the key
-   @param char* value: the value
+   @param void* key: the key
  **/
-void ht_delete(ht_hash_table* h, const char* key);
+void ht_delete(ht_hash_table* h, const void* key);
+
+/**
+   Delete an element by a (pointer, length) key
+   @param ht_hash_table* ht: the Hash Table
+   @param void* key: the key bytes
+   @param size_t len: the key length
+ **/
+void ht_delete_n(ht_hash_table* ht, const void* key, size_t len);
+
+#endif
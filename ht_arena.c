@@ -0,0 +1,133 @@
+/* -*- compile-command: "gcc -Wall -pedantic -g3 -c ht_arena.c" -*- */
+/**
+   Arena for the key and value bytes of a Hash Table
+   Small blocks are cut from 64 KB chunks by bump allocation and, once freed,
+   reused through one free list per size class: the size is passed back on
+   free (the table knows every key and value length), so blocks carry no
+   header. Destroying the arena costs one free per chunk, not per block.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "ht_arena.h"
+
+struct ht_arena_chunk {
+    ht_arena_chunk* next;
+    size_t pad;              // keeps the data 16-byte aligned
+};
+
+struct ht_arena_large {
+    ht_arena_large* prev;
+    ht_arena_large* next;
+};
+
+
+/**
+   #Internal
+   * Size class of a block: the smallest power of two from HT_ARENA_MIN_BLOCK
+   * holding size bytes, HT_ARENA_CLASSES for large blocks
+ **/
+static inline int ht_arena_class(const size_t size)
+{
+    int c = 0;
+    for (size_t block = HT_ARENA_MIN_BLOCK; block < size; block <<= 1) {
+        if (++c == HT_ARENA_CLASSES) {
+            break;
+        }
+    }
+    return c;
+}
+
+/** Create an empty arena **/
+ht_arena* ht_arena_new(const ht_allocator* allocator)
+{
+    // zeroed: no chunk, every free list empty
+    ht_arena* a = allocator->alloc_zeroed(allocator->ctx, 1, sizeof(ht_arena));
+    if (a == NULL) return NULL;
+    a->allocator = allocator;
+    return a;
+}
+
+
+/******* ADD *******/
+void* ht_arena_alloc(ht_arena* a, const size_t size)
+{
+    const int c = ht_arena_class(size);
+
+    // large: its own allocation, on a list so it can be freed alone
+    if (c == HT_ARENA_CLASSES) {
+        ht_arena_large* l = a->allocator->alloc(a->allocator->ctx, sizeof(ht_arena_large) + size);
+        if (l == NULL) return NULL;
+        l->prev = NULL;
+        l->next = a->large;
+        if (a->large != NULL) {
+            a->large->prev = l;
+        }
+        a->large = l;
+        return l + 1;
+    }
+
+    // a freed block of the class
+    void* p = a->free_list[c];
+    if (p != NULL) {
+        a->free_list[c] = *(void**)p;
+        return p;
+    }
+
+    // bump; what is left of a full chunk is lost
+    const size_t block = (size_t)HT_ARENA_MIN_BLOCK << c;
+    if (a->left < block) {
+        ht_arena_chunk* chunk = a->allocator->alloc(a->allocator->ctx,
+                                                    sizeof(ht_arena_chunk) + HT_ARENA_CHUNK);
+        if (chunk == NULL) return NULL;
+        chunk->next = a->chunks;
+        a->chunks = chunk;
+        a->bump = (char*)(chunk + 1);
+        a->left = HT_ARENA_CHUNK;
+    }
+    p = a->bump;
+    a->bump += block;
+    a->left -= block;
+    return p;
+}
+
+
+/******** REMOVE *********/
+void ht_arena_free(ht_arena* a, void* p, const size_t size)
+{
+    if (p == NULL) {
+        return;
+    }
+    const int c = ht_arena_class(size);
+    if (c == HT_ARENA_CLASSES) {
+        ht_arena_large* l = (ht_arena_large*)p - 1;
+        if (l->prev != NULL) {
+            l->prev->next = l->next;
+        } else {
+            a->large = l->next;
+        }
+        if (l->next != NULL) {
+            l->next->prev = l->prev;
+        }
+        a->allocator->free(a->allocator->ctx, l);
+        return;
+    }
+    *(void**)p = a->free_list[c];
+    a->free_list[c] = p;
+}
+
+/** Free the arena and every block in it **/
+void ht_arena_del(ht_arena* a)
+{
+    while (a->chunks != NULL) {
+        ht_arena_chunk* next = a->chunks->next;
+        a->allocator->free(a->allocator->ctx, a->chunks);
+        a->chunks = next;
+    }
+    while (a->large != NULL) {
+        ht_arena_large* next = a->large->next;
+        a->allocator->free(a->allocator->ctx, a->large);
+        a->large = next;
+    }
+    a->allocator->free(a->allocator->ctx, a);
+}
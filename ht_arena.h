@@ -0,0 +1,61 @@
+/**
+   Arena for the key and value bytes of a Hash Table
+**/
+
+#ifndef HT_ARENA_H
+#define HT_ARENA_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "hash_table.h"
+
+/* Size classes: 16, 32, ... 2048 bytes; larger blocks get their own allocation */
+#define HT_ARENA_CLASSES   8
+#define HT_ARENA_MIN_BLOCK 16
+#define HT_ARENA_CHUNK     (64 * 1024)
+
+typedef struct ht_arena_chunk ht_arena_chunk;
+typedef struct ht_arena_large ht_arena_large;
+
+// Arena: chunks cut by bump allocation, freed blocks kept per size class
+typedef struct ht_arena {
+    ht_arena_chunk* chunks;              // every chunk, freed together
+    ht_arena_large* large;               // blocks above the largest class
+    char* bump;                          // next free byte of the current chunk
+    size_t left;                         // bytes left after bump
+    void* free_list[HT_ARENA_CLASSES];   // freed blocks, linked through their first word
+    const ht_allocator* allocator;       // where chunks come from
+} ht_arena;
+
+
+
+/**
+   Create an empty arena
+   @param ht_allocator* allocator: where the arena and its chunks come from
+   @return ht_arena the arena, NULL if out of memory
+ **/
+ht_arena* ht_arena_new(const ht_allocator* allocator);
+
+/**
+   Allocate size bytes (aligned to 16 up to the largest class)
+   @param ht_arena* a: the arena
+   @param size_t size: the number of bytes
+   @return the block, NULL if out of memory
+ **/
+void* ht_arena_alloc(ht_arena* a, size_t size);
+
+/**
+   Give a block back to its size class
+   @param ht_arena* a: the arena
+   @param void* p: the block
+   @param size_t size: the size it was allocated with
+ **/
+void ht_arena_free(ht_arena* a, void* p, size_t size);
+
+/**
+   Free the arena and every block in it, one free per chunk
+   @param ht_arena* a: the arena
+ **/
+void ht_arena_del(ht_arena* a);
+
+#endif
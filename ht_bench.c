@@ -0,0 +1,920 @@
+/* -*- compile-command: "gcc -Wall -pedantic -O2 ht_bench.c hash_table.c prime.c ht_arena.c ht_u64.c -o ht_bench" -*- */
+/**
+   Benchmarks for the Hash Table
+   usage: ht_bench [--max=N] [name ...]   (no name runs all of them)
+          --max=N raises the largest table size of the sweeping benchmarks
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include "hash_table.h"
+#include "ht_declare.h"
+#include "ht_u64.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_TICK_UNIT "cycles"
+static inline uint64_t bench_ticks(void)
+{
+    return __rdtsc();
+}
+#else
+#define BENCH_TICK_UNIT "ns"
+static inline uint64_t bench_ticks(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+#define BENCH_KEY_LEN 24
+#define BENCH_SAMPLES 200000
+#define BENCH_DEFAULT_MAX 1000000
+
+/* largest table of the sweeping benchmarks (--max) */
+static size_t bench_max = BENCH_DEFAULT_MAX;
+
+
+/**
+   * Keys used by all benchmarks: n NUL-terminated keys, BENCH_KEY_LEN bytes apart.
+   * The same index always gives the same key, so "hit" and "miss" sets can be
+   * taken from disjoint index ranges.
+ **/
+typedef struct {
+    char* buf;
+    size_t n;
+} bench_keys;
+
+static bench_keys bench_keys_new(const size_t first, const size_t n)
+{
+    bench_keys k;
+    k.n = n;
+    k.buf = malloc(n * BENCH_KEY_LEN);
+    for (size_t i = 0; i < n; i++) {
+        snprintf(k.buf + i * BENCH_KEY_LEN, BENCH_KEY_LEN, "key:%016llx",
+                 (unsigned long long)((first + i) * 0x9e3779b97f4a7c15ULL));
+    }
+    return k;
+}
+
+static inline const char* bench_key(const bench_keys* k, const size_t i)
+{
+    return k->buf + i * BENCH_KEY_LEN;
+}
+
+static void bench_keys_free(bench_keys* k)
+{
+    free(k->buf);
+}
+
+/**
+   * Bytes currently allocated from the heap, or 0 when it cannot be known
+ **/
+static size_t bench_heap_bytes(void)
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    const struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+/* wall clock in seconds */
+static double bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* xorshift, enough to pick random sample indices */
+static inline uint64_t bench_rand(uint64_t* s)
+{
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+/**
+   * Average ticks per ht_search over BENCH_SAMPLES random keys among the first n
+ **/
+static double bench_lookup(ht_hash_table* ht, const bench_keys* keys, const size_t n)
+{
+    uint64_t seed = 88172645463325252ULL;
+    size_t found = 0;
+    const uint64_t t0 = bench_ticks();
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        found += ht_search(ht, bench_key(keys, bench_rand(&seed) % n)) != NULL;
+    }
+    const uint64_t t1 = bench_ticks();
+    if (found == (size_t)-1) printf("unreachable\n");
+    return (double)(t1 - t0) / BENCH_SAMPLES;
+}
+
+
+/**
+   * Hardware cache-miss counter of this thread (user space only), or -1 when
+   * the kernel or the machine has none (e.g. perf_event_paranoid > 2, VMs
+   * without a PMU): the benchmark then prints n/a
+ **/
+static int bench_perf_open(void)
+{
+#if defined(__linux__)
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+/* Cache misses per ht_search over BENCH_SAMPLES random keys, -1 without a counter */
+static double bench_lookup_misses(int fd, ht_hash_table* ht, const bench_keys* keys, const size_t n)
+{
+#if defined(__linux__)
+    if (fd >= 0) {
+        uint64_t count = 0;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        bench_lookup(ht, keys, n);
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &count, sizeof(count)) == (ssize_t)sizeof(count)) {
+            return (double)count / BENCH_SAMPLES;
+        }
+    }
+#else
+    (void)fd; (void)ht; (void)keys; (void)n;
+#endif
+    return -1;
+}
+
+
+/****** PROBE ******/
+/**
+   * Cost per lookup while the load factor goes up.
+   * Keys are inserted until the table is at least min_size buckets; from then on,
+   * every 5% of load until the next resize, hits and misses are timed.
+ **/
+static void bench_probe_engine(const char* name, const ht_probe_mode probe,
+                               const ht_size_mode sizing,
+                               const bench_keys* keys, const bench_keys* miss)
+{
+    const size_t min_size = 1 << 19;
+    ht_config cfg;
+    ht_config_init(&cfg);
+    cfg.probe = probe;
+    cfg.sizing = sizing;
+
+    ht_hash_table* ht = ht_new_ex(&cfg);
+    size_t epoch_size = 0;
+    int next_load = 0;
+    for (size_t i = 0; i < keys->n; i++) {
+        ht_insert(ht, bench_key(keys, i), "v");
+        if (ht->size < min_size) {
+            continue;
+        }
+        if (epoch_size == 0) {
+            epoch_size = ht->size;
+            next_load = (int)((double)ht->count * 100 / ht->size) / 5 * 5 + 5;
+        }
+        if (ht->size != epoch_size) {
+            break;
+        }
+        const double load = (double)ht->count * 100 / ht->size;
+        if (load >= next_load) {
+            printf("%12s %8d %10zu %10.1f %10.1f\n", name, next_load, ht->size,
+                   bench_lookup(ht, keys, i + 1),
+                   bench_lookup(ht, miss, miss->n));
+            next_load += 5;
+        }
+    }
+    ht_del_hash_table(ht);
+}
+
+static void bench_probe(void)
+{
+    const size_t max_keys = 1 << 21;
+    bench_keys keys = bench_keys_new(0, max_keys);
+    bench_keys miss = bench_keys_new(max_keys, max_keys);
+
+    printf("== probe: %s per lookup vs load factor\n", BENCH_TICK_UNIT);
+    printf("%12s %8s %10s %10s %10s\n", "engine", "load%", "size", "hit", "miss");
+    bench_probe_engine("double", HT_PROBE_DOUBLE, HT_SIZE_PRIME, &keys, &miss);
+    bench_probe_engine("double/pow2", HT_PROBE_DOUBLE, HT_SIZE_POW2, &keys, &miss);
+    bench_probe_engine("group", HT_PROBE_GROUP, HT_SIZE_PRIME, &keys, &miss);
+    bench_probe_engine("group/pow2", HT_PROBE_GROUP, HT_SIZE_POW2, &keys, &miss);
+    bench_keys_free(&keys);
+    bench_keys_free(&miss);
+}
+
+
+/****** CHURN ******/
+/**
+   * Lookup cost of a table kept at a constant number of live entries while
+   * every round deletes and re-inserts as many keys as it holds.
+   * Tombstones left by the double and group engines are reused by insert
+   * and purged by a same-size rehash; "deleted" is their count at the end
+   * of the round.
+ **/
+static void bench_churn_engine(const char* name, const ht_probe_mode probe,
+                               const bench_keys* keys, const size_t live)
+{
+    ht_config cfg;
+    ht_config_init(&cfg);
+    cfg.probe = probe;
+
+    ht_hash_table* ht = ht_new_ex(&cfg);
+    for (size_t i = 0; i < live; i++) {
+        ht_insert(ht, bench_key(keys, i), "v");
+    }
+    // keys [first, first + live) are in the table
+    size_t first = 0;
+    for (int round = 0; round <= 8; round++) {
+        if (round > 0) {
+            for (size_t i = 0; i < live; i++) {
+                ht_delete(ht, bench_key(keys, (first + i) % keys->n));
+                ht_insert(ht, bench_key(keys, (first + live + i) % keys->n), "v");
+            }
+            first = (first + live) % keys->n;
+        }
+        bench_keys hit = {keys->buf + first * BENCH_KEY_LEN, live};
+        const size_t next = (first + live) % keys->n;
+        bench_keys miss = {keys->buf + next * BENCH_KEY_LEN, live};
+        printf("%12s %6d %10zu %10zu %10.1f %10.1f\n", name, round, ht->size, ht->deleted,
+               bench_lookup(ht, &hit, live), bench_lookup(ht, &miss, live));
+    }
+    ht_del_hash_table(ht);
+}
+
+static void bench_churn(void)
+{
+    const size_t live = 1 << 18;
+    // live keys move forward by live every round, wrapping around the key set
+    bench_keys keys = bench_keys_new(0, 3 * live);
+
+    printf("== churn: %zu live keys, %s per lookup after each round\n", live, BENCH_TICK_UNIT);
+    printf("%12s %6s %10s %10s %10s %10s\n", "engine", "round", "size", "deleted", "hit", "miss");
+    bench_churn_engine("double", HT_PROBE_DOUBLE, &keys, live);
+    bench_churn_engine("group", HT_PROBE_GROUP, &keys, live);
+    bench_churn_engine("robin_hood", HT_PROBE_ROBIN_HOOD, &keys, live);
+    bench_keys_free(&keys);
+}
+
+
+/****** CACHEMISS ******/
+/**
+   * Cache misses on the probe path, per lookup, in a table of 1M entries.
+   * Slots cache the full hash and the key length, so a miss should cost
+   * about the slot lines alone (plus the control bytes of the group engine)
+   * and a hit one more line for the key it compares.
+ **/
+static void bench_cachemiss_engine(const char* name, const ht_probe_mode probe, const int fd,
+                                   const bench_keys* keys, const bench_keys* miss)
+{
+    ht_config cfg;
+    ht_config_init(&cfg);
+    cfg.probe = probe;
+    ht_hash_table* ht = ht_new_ex(&cfg);
+    for (size_t i = 0; i < keys->n; i++) {
+        ht_insert(ht, bench_key(keys, i), "v");
+    }
+    const double hit = bench_lookup_misses(fd, ht, keys, keys->n);
+    const double missed = bench_lookup_misses(fd, ht, miss, miss->n);
+    if (hit < 0) {
+        printf("%12s %10s %10s %10.1f %10.1f\n", name, "n/a", "n/a",
+               bench_lookup(ht, keys, keys->n), bench_lookup(ht, miss, miss->n));
+    } else {
+        printf("%12s %10.2f %10.2f %10.1f %10.1f\n", name, hit, missed,
+               bench_lookup(ht, keys, keys->n), bench_lookup(ht, miss, miss->n));
+    }
+    ht_del_hash_table(ht);
+}
+
+static void bench_cachemiss(void)
+{
+    const size_t n = 1 << 20;
+    bench_keys keys = bench_keys_new(0, n);
+    bench_keys miss = bench_keys_new(n, n);
+    const int fd = bench_perf_open();
+
+    printf("== cachemiss: %zu entries, cache misses and %s per lookup\n", n, BENCH_TICK_UNIT);
+    printf("%12s %10s %10s %10s %10s\n", "engine", "hit miss", "miss miss", "hit", "miss");
+    bench_cachemiss_engine("double", HT_PROBE_DOUBLE, fd, &keys, &miss);
+    bench_cachemiss_engine("group", HT_PROBE_GROUP, fd, &keys, &miss);
+    bench_cachemiss_engine("robin_hood", HT_PROBE_ROBIN_HOOD, fd, &keys, &miss);
+#if defined(__linux__)
+    if (fd >= 0) {
+        close(fd);
+    }
+#endif
+    bench_keys_free(&keys);
+    bench_keys_free(&miss);
+}
+
+
+/****** RESIZE ******/
+static int bench_cmp_double(const void* a, const void* b)
+{
+    const double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+   * Resize pause: the slowest single ht_insert while growing a table to n
+   * entries is the insert that paid for the last (largest) resize.
+   * Done with synchronous and with incremental resizing, with the
+   * 99.99th percentile of the insert latency.
+ **/
+static void bench_resize(void)
+{
+    bench_keys keys = bench_keys_new(0, bench_max);
+    double* lat = malloc(bench_max * sizeof(double));
+
+    printf("== resize: insert latency while growing to n entries\n");
+    printf("%12s %12s %12s %12s %12s %10s\n", "mode", "n", "size", "max ms", "p99.99 us", "total s");
+    for (size_t n = 1000; n <= bench_max; n *= 10) {
+        for (int incremental = 0; incremental <= 1; incremental++) {
+            ht_config cfg;
+            ht_config_init(&cfg);
+            cfg.incremental_resize = incremental;
+            ht_hash_table* ht = ht_new_ex(&cfg);
+            const double start = bench_now();
+            for (size_t i = 0; i < n; i++) {
+                const double t0 = bench_now();
+                ht_insert(ht, bench_key(&keys, i), "v");
+                lat[i] = bench_now() - t0;
+            }
+            const double total = bench_now() - start;
+            qsort(lat, n, sizeof(double), bench_cmp_double);
+            printf("%12s %12zu %12zu %12.3f %12.2f %10.3f\n",
+                   incremental ? "incremental" : "sync", n, ht->size,
+                   lat[n - 1] * 1e3, lat[n - 1 - n / 10000] * 1e6, total);
+            ht_del_hash_table(ht);
+        }
+    }
+    free(lat);
+    bench_keys_free(&keys);
+}
+
+
+/****** RESERVE ******/
+/**
+   * Bulk load of --max keys into a table grown from HT_INITIAL_BASE_SIZE
+   * (one resize per doubling) and into a table sized by ht_reserve (none).
+   * With copied keys the two mallocs per insert hide most of the resizes;
+   * borrowed keys show them.
+ **/
+static void bench_reserve(void)
+{
+    bench_keys keys = bench_keys_new(0, bench_max);
+
+    printf("== reserve: bulk load of %zu keys\n", bench_max);
+    printf("%-8s %-10s %12s %12s %12s\n", "keys", "table", "size", "total s", "ns/insert");
+    for (int borrow = 0; borrow <= 1; borrow++) {
+        for (int reserve = 0; reserve <= 1; reserve++) {
+            ht_config cfg;
+            ht_config_init(&cfg);
+            if (borrow) {
+                cfg.key_own = HT_OWN_BORROW;
+                cfg.value_own = HT_OWN_BORROW;
+            }
+            const double start = bench_now();
+            ht_hash_table* ht = ht_new_ex(&cfg);
+            if (reserve) {
+                ht_reserve(ht, bench_max);
+            }
+            for (size_t i = 0; i < bench_max; i++) {
+                ht_insert(ht, bench_key(&keys, i), "v");
+            }
+            const double total = bench_now() - start;
+            printf("%-8s %-10s %12zu %12.3f %12.1f\n", borrow ? "borrow" : "copy",
+                   reserve ? "reserve" : "grow", ht->size, total, total * 1e9 / bench_max);
+            ht_del_hash_table(ht);
+        }
+    }
+    bench_keys_free(&keys);
+}
+
+
+/****** BATCH ******/
+/**
+   * Bulk load of n uint64 keys (borrowed from an array) with inline uint64
+   * values, at 1M, 10M, ... up to --max pairs (--max=100000000 needs about
+   * 8 GB): one ht_insert per pair on a growing table, the same loop after
+   * ht_reserve, and ht_insert_batch (one resize, prefetched buckets).
+   * Millions of inserts per second.
+ **/
+static void bench_batch(void)
+{
+    printf("== batch: uint64 -> uint64 bulk load, Minserts/s\n");
+    printf("%12s %12s %12s %12s\n", "n", "loop", "reserve+loop", "batch");
+    for (size_t n = 1000000; n <= bench_max; n *= 10) {
+        uint64_t* ids = malloc(n * sizeof(uint64_t));
+        const void** keys = malloc(n * sizeof(void*));
+        const void** values = malloc(n * sizeof(void*));
+        uint64_t seed = 1;
+        for (size_t i = 0; i < n; i++) {
+            ids[i] = bench_rand(&seed);
+            keys[i] = &ids[i];
+            values[i] = &ids[i];
+        }
+
+        double rate[3];
+        for (int way = 0; way < 3; way++) {
+            ht_config cfg;
+            ht_config_init(&cfg);
+            cfg.key_size = sizeof(uint64_t);
+            cfg.value_size = sizeof(uint64_t);
+            cfg.key_own = HT_OWN_BORROW;
+            cfg.inline_values = 1;
+            ht_hash_table* ht = ht_new_ex(&cfg);
+            const double start = bench_now();
+            if (way == 2) {
+                ht_insert_batch(ht, keys, values, n);
+            } else {
+                if (way == 1) {
+                    ht_reserve(ht, n);
+                }
+                for (size_t i = 0; i < n; i++) {
+                    ht_insert(ht, keys[i], values[i]);
+                }
+            }
+            rate[way] = n / (bench_now() - start) / 1e6;
+            if (ht->count != n || *(uint64_t*)ht_search(ht, keys[n / 2]) != ids[n / 2]) {
+                printf("batch: %zu entries, WRONG\n", ht->count);
+            }
+            ht_del_hash_table(ht);
+        }
+        printf("%12zu %12.2f %12.2f %12.2f\n", n, rate[0], rate[1], rate[2]);
+        free(ids);
+        free(keys);
+        free(values);
+    }
+}
+
+
+/****** MULTIGET ******/
+/**
+   * Lookups of batches of 64 random keys, all present, at 1M, 10M, ... up to
+   * --max uint64 keys (copied, so a hit also reads the stored key) with inline
+   * values: one ht_search per key against ht_search_batch, for each engine.
+   * Millions of lookups per second.
+ **/
+static void bench_multiget(void)
+{
+    const size_t batch = 64;
+    const size_t lookups = 4000000;
+    const ht_probe_mode probes[] = {HT_PROBE_DOUBLE, HT_PROBE_GROUP, HT_PROBE_ROBIN_HOOD};
+    const char* names[] = {"double", "group", "robin_hood"};
+    const void* keys[64];
+    void* values[64];
+
+    printf("== multiget: batches of %zu keys, Mlookups/s\n", batch);
+    printf("%12s %12s %10s %10s\n", "engine", "n", "loop", "batch");
+    for (size_t n = 1000000; n <= bench_max; n *= 10) {
+        uint64_t* ids = malloc(n * sizeof(uint64_t));
+        uint64_t seed = 1;
+        for (size_t i = 0; i < n; i++) {
+            ids[i] = bench_rand(&seed);
+        }
+        for (size_t e = 0; e < sizeof(probes) / sizeof(probes[0]); e++) {
+            ht_config cfg;
+            ht_config_init(&cfg);
+            cfg.probe = probes[e];
+            cfg.key_size = sizeof(uint64_t);
+            cfg.value_size = sizeof(uint64_t);
+            cfg.inline_values = 1;
+            ht_hash_table* ht = ht_new_ex(&cfg);
+            for (size_t i = 0; i < n; i++) {
+                ht_insert(ht, &ids[i], &ids[i]);
+            }
+
+            double rate[2];
+            for (int batched = 0; batched <= 1; batched++) {
+                size_t found = 0;
+                seed = 2;
+                const double start = bench_now();
+                for (size_t done = 0; done < lookups; done += batch) {
+                    for (size_t i = 0; i < batch; i++) {
+                        keys[i] = &ids[bench_rand(&seed) % n];
+                    }
+                    if (batched) {
+                        ht_search_batch(ht, keys, values, batch);
+                        for (size_t i = 0; i < batch; i++) {
+                            found += values[i] != NULL;
+                        }
+                    } else {
+                        for (size_t i = 0; i < batch; i++) {
+                            found += ht_search(ht, keys[i]) != NULL;
+                        }
+                    }
+                }
+                rate[batched] = lookups / (bench_now() - start) / 1e6;
+                if (found != lookups) {
+                    printf("multiget: %zu found, WRONG\n", found);
+                }
+            }
+            printf("%12s %12zu %10.2f %10.2f\n", names[e], n, rate[0], rate[1]);
+            ht_del_hash_table(ht);
+        }
+        free(ids);
+    }
+}
+
+
+/****** STRESS ******/
+/**
+   * Insert --max small keys (default 1M), then check the count and a sample
+   * of them. Meant for very large tables: e.g. --max=3200000000 goes well past
+   * 2^31 entries and 2^32 slots (it needs a few hundred GB of memory).
+   * Keys are formatted on the fly, nothing is kept outside the table.
+ **/
+static void bench_stress(void)
+{
+    char key[24];
+    printf("== stress: %zu keys\n", bench_max);
+    ht_hash_table* ht = ht_new();
+    const double start = bench_now();
+    for (size_t i = 0; i < bench_max; i++) {
+        snprintf(key, sizeof(key), "%zx", i);
+        ht_insert(ht, key, "");
+        if ((i & ((1 << 28) - 1)) == 0 && i > 0) {
+            printf("%14zu keys %14zu slots %10.1f s\n", i, ht->size, bench_now() - start);
+            fflush(stdout);
+        }
+    }
+    size_t missing = 0;
+    for (size_t i = 0; i < bench_max; i += 1 + bench_max / BENCH_SAMPLES) {
+        snprintf(key, sizeof(key), "%zx", i);
+        missing += ht_search(ht, key) == NULL;
+    }
+    printf("%14zu keys %14zu slots %10.1f s, count %s, %zu sampled keys missing\n",
+           bench_max, ht->size, bench_now() - start,
+           ht->count == bench_max ? "ok" : "WRONG", missing);
+    ht_del_hash_table(ht);
+}
+
+
+/****** MEMORY ******/
+/**
+   * Heap bytes per entry, insert and destroy time and lookup latency of a
+   * table of 1M entries, with keys and values copied by malloc or in the
+   * table arena. Keys are 20 bytes and values 8 bytes, so the payload alone
+   * is 30 bytes with the terminators; the rest is slot and allocator overhead.
+ **/
+static void bench_memory(void)
+{
+    const size_t n = 1 << 20;
+    bench_keys keys = bench_keys_new(0, n);
+    bench_keys miss = bench_keys_new(n, n);
+
+    printf("== memory: %zu entries\n", n);
+    printf("%-8s %12s %12s %12s %10s %10s\n", "copies", "bytes/entry", "ns/insert",
+           "destroy ms", "hit", "miss");
+    for (int arena = 0; arena <= 1; arena++) {
+        ht_config cfg;
+        ht_config_init(&cfg);
+        cfg.arena = arena;
+        const size_t before = bench_heap_bytes();
+        double start = bench_now();
+        ht_hash_table* ht = ht_new_ex(&cfg);
+        for (size_t i = 0; i < n; i++) {
+            ht_insert(ht, bench_key(&keys, i), "value-01");
+        }
+        const double insert = (bench_now() - start) * 1e9 / n;
+        const size_t after = bench_heap_bytes();
+        const double hit = bench_lookup(ht, &keys, n);
+        const double missed = bench_lookup(ht, &miss, n);
+        start = bench_now();
+        ht_del_hash_table(ht);
+        printf("%-8s %12.1f %12.1f %12.2f %10.1f %10.1f\n", arena ? "arena" : "malloc",
+               (double)(after - before) / n, insert, (bench_now() - start) * 1e3, hit, missed);
+    }
+    bench_keys_free(&keys);
+    bench_keys_free(&miss);
+}
+
+
+/****** INLINE ******/
+/* Heap copy made through a dup callback: the table cannot keep it in the slot */
+static void* bench_dup(const void* p, const size_t len)
+{
+    char* d = malloc(len + 1);
+    memcpy(d, p, len);
+    d[len] = '\0';
+    return d;
+}
+
+/**
+   * Short tokens (up to 6 bytes) and 2-byte values: kept in the slot, or
+   * copied to the heap as before (forced with dup/free callbacks).
+   * Heap bytes per entry, insert time and lookup latency of 1M entries.
+ **/
+static void bench_inline(void)
+{
+    const size_t n = 1 << 20;
+    char (*tokens)[8] = malloc(n * 2 * sizeof(*tokens));
+    for (size_t i = 0; i < n * 2; i++) {
+        snprintf(tokens[i], sizeof(tokens[i]), "%llx",
+                 (unsigned long long)(i * 0x9e3779b1ULL % 0xfffffff));
+    }
+
+    printf("== inline: %zu short keys, ns per insert, %s per lookup\n", n, BENCH_TICK_UNIT);
+    printf("%-8s %12s %12s %10s %10s\n", "copies", "bytes/entry", "ns/insert", "hit", "miss");
+    for (int heap = 0; heap <= 1; heap++) {
+        ht_config cfg;
+        ht_config_init(&cfg);
+        if (heap) {
+            cfg.key_dup = cfg.value_dup = bench_dup;
+            cfg.key_free = cfg.value_free = free;
+        }
+        const size_t before = bench_heap_bytes();
+        const double start = bench_now();
+        ht_hash_table* ht = ht_new_ex(&cfg);
+        for (size_t i = 0; i < n; i++) {
+            ht_insert(ht, tokens[i], "v");
+        }
+        const double insert = (bench_now() - start) * 1e9 / n;
+        const size_t after = bench_heap_bytes();
+        uint64_t seed = 1, found = 0;
+        uint64_t t0 = bench_ticks();
+        for (size_t i = 0; i < BENCH_SAMPLES; i++) {
+            found += ht_search(ht, tokens[bench_rand(&seed) % n]) != NULL;
+        }
+        const double hit = (double)(bench_ticks() - t0) / BENCH_SAMPLES;
+        t0 = bench_ticks();
+        for (size_t i = 0; i < BENCH_SAMPLES; i++) {
+            found += ht_search(ht, tokens[n + bench_rand(&seed) % n]) != NULL;
+        }
+        const double missed = (double)(bench_ticks() - t0) / BENCH_SAMPLES;
+        printf("%-8s %12.1f %12.1f %10.1f %10.1f\n", heap ? "heap" : "inline",
+               (double)(after - before) / n, insert, hit, missed);
+        ht_del_hash_table(ht);
+        if (found > BENCH_SAMPLES) {
+            printf("unexpected hits on missing keys\n");
+        }
+    }
+    free(tokens);
+}
+
+
+/****** FASTMOD ******/
+/**
+   * Reduction of random 64-bit hashes by tabulated primes: the hardware
+   * divide (%) against fastmod. The sums are printed so neither loop is dropped.
+ **/
+static void bench_fastmod(void)
+{
+    const size_t n = 1 << 22;
+    const uint64_t sizes[] = {53, 1 << 16, 1 << 24, 1ULL << 40};
+
+    printf("== fastmod: %zu reductions, " BENCH_TICK_UNIT "/op\n", n);
+    printf("%20s %10s %10s\n", "prime", "%", "fastmod");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        const prime_size* ps = next_prime_size(sizes[i]);
+        uint64_t seed = 1, sum_div = 0, sum_fast = 0;
+        uint64_t start = bench_ticks();
+        for (size_t j = 0; j < n; j++) {
+            sum_div += bench_rand(&seed) % ps->p;
+        }
+        const double div = (double)(bench_ticks() - start) / n;
+        seed = 1;
+        start = bench_ticks();
+        for (size_t j = 0; j < n; j++) {
+            sum_fast += fastmod(bench_rand(&seed), ps);
+        }
+        const double fast = (double)(bench_ticks() - start) / n;
+        printf("%20llu %10.2f %10.2f%s\n", (unsigned long long)ps->p, div, fast,
+               sum_div == sum_fast ? "" : "  MISMATCH");
+    }
+}
+
+
+/****** DECLARE ******/
+HT_DECLARE(bench_u64map, uint64_t, uint64_t, ht_hash_u64, ht_eq_u64)
+
+/**
+   * uint64 -> uint64 map, three ways: the char* table with the numbers
+   * formatted as strings, the generic table with 8-byte keys and values,
+   * and the HT_DECLARE instantiation. ns per operation over --max keys.
+ **/
+static void bench_declare(void)
+{
+    const size_t n = bench_max;
+    uint64_t* ids = malloc(n * sizeof(uint64_t));
+    uint64_t seed = 1;
+    for (size_t i = 0; i < n; i++) {
+        ids[i] = bench_rand(&seed);
+    }
+
+    printf("== declare: %zu uint64 -> uint64, ns/op\n", n);
+    printf("%-16s %10s %10s %10s\n", "table", "insert", "hit", "miss");
+    for (int way = 0; way < 4; way++) {
+        ht_hash_table* ht = NULL;
+        bench_u64map_table* map = NULL;
+        char key[24], value[24];
+        const char* names[] = {"char*", "void*", "void* inline", "HT_DECLARE"};
+        const char* name = names[way];
+        // ways 1 and 2: 8-byte keys and values, the values copied or in the slot
+        const int generic = way == 1 || way == 2;
+        if (way == 0) {
+            ht = ht_new();
+        } else if (generic) {
+            ht_config cfg;
+            ht_config_init(&cfg);
+            cfg.key_size = sizeof(uint64_t);
+            cfg.value_size = sizeof(uint64_t);
+            cfg.inline_values = way == 2;
+            ht = ht_new_ex(&cfg);
+        } else {
+            map = bench_u64map_new();
+        }
+
+        double times[3];
+        for (int phase = 0; phase < 3; phase++) {
+            size_t found = 0;
+            const double start = bench_now();
+            for (size_t i = 0; i < n; i++) {
+                // phase 2 looks up ids that were never inserted
+                const uint64_t id = phase == 2 ? ~ids[i] : ids[i];
+                if (way == 0) {
+                    snprintf(key, sizeof(key), "%llu", (unsigned long long)id);
+                    if (phase == 0) {
+                        snprintf(value, sizeof(value), "%llu", (unsigned long long)i);
+                        ht_insert(ht, key, value);
+                    } else {
+                        found += ht_search(ht, key) != NULL;
+                    }
+                } else if (generic) {
+                    if (phase == 0) {
+                        ht_insert(ht, &id, &i);
+                    } else {
+                        found += ht_search(ht, &id) != NULL;
+                    }
+                } else {
+                    if (phase == 0) {
+                        bench_u64map_insert(map, id, i);
+                    } else {
+                        found += bench_u64map_search(map, id) != NULL;
+                    }
+                }
+            }
+            times[phase] = (bench_now() - start) * 1e9 / n;
+            if (phase != 0 && found != (phase == 1 ? n : 0)) {
+                printf("%s: %zu found, WRONG\n", name, found);
+            }
+        }
+        printf("%-16s %10.1f %10.1f %10.1f\n", name, times[0], times[1], times[2]);
+        if (ht != NULL) {
+            ht_del_hash_table(ht);
+        } else {
+            bench_u64map_del_table(map);
+        }
+    }
+    free(ids);
+}
+
+
+/****** U64 ******/
+/**
+   * Integer map at 1M, 10M, ... up to --max keys (--max=100000000 needs
+   * about 6 GB at the last resize): insert n keys, look up BENCH_SAMPLES
+   * random hits and misses, delete every key. ns per operation.
+   * Key i is ht_hash_u64(i + 1), a bijection: random looking keys that
+   * can be regenerated from their index, so nothing is kept aside.
+   * The generic table with 8-byte keys and values runs alongside up to 10M.
+ **/
+static void bench_u64(void)
+{
+    printf("== u64: uint64 -> uint64 map, ns/op\n");
+    printf("%-8s %12s %12s %10s %10s %10s %10s\n",
+           "table", "n", "size", "insert", "hit", "miss", "delete");
+    for (size_t n = 1000000; n <= bench_max; n *= 10) {
+        for (int generic = 0; generic <= (n <= 10000000); generic++) {
+            ht_u64_map* map = NULL;
+            ht_hash_table* ht = NULL;
+            if (generic) {
+                ht_config cfg;
+                ht_config_init(&cfg);
+                cfg.key_size = sizeof(uint64_t);
+                cfg.value_size = sizeof(uint64_t);
+                ht = ht_new_ex(&cfg);
+            } else {
+                map = ht_u64_new();
+            }
+
+            double start = bench_now();
+            for (size_t i = 0; i < n; i++) {
+                const uint64_t key = ht_hash_u64(i + 1);
+                if (generic) {
+                    ht_insert(ht, &key, &i);
+                } else {
+                    ht_u64_insert(map, key, i);
+                }
+            }
+            const double insert = (bench_now() - start) * 1e9 / n;
+            const size_t size = generic ? ht->size : map->size;
+
+            double lookup[2];
+            for (int miss = 0; miss <= 1; miss++) {
+                size_t found = 0;
+                uint64_t seed = 1;
+                start = bench_now();
+                for (size_t s = 0; s < BENCH_SAMPLES; s++) {
+                    // misses are the indices from n + 1 on
+                    const uint64_t key = ht_hash_u64(bench_rand(&seed) % n + 1 + (miss ? n : 0));
+                    found += generic ? ht_search(ht, &key) != NULL
+                                     : ht_u64_search(map, key) != NULL;
+                }
+                lookup[miss] = (bench_now() - start) * 1e9 / BENCH_SAMPLES;
+                if (found != (miss ? 0 : BENCH_SAMPLES)) {
+                    printf("%zu found, WRONG\n", found);
+                }
+            }
+
+            start = bench_now();
+            for (size_t i = 0; i < n; i++) {
+                const uint64_t key = ht_hash_u64(i + 1);
+                if (generic) {
+                    ht_delete(ht, &key);
+                } else {
+                    ht_u64_delete(map, key);
+                }
+            }
+            const double del = (bench_now() - start) * 1e9 / n;
+            printf("%-8s %12zu %12zu %10.1f %10.1f %10.1f %10.1f\n",
+                   generic ? "void*" : "ht_u64", n, size, insert, lookup[0], lookup[1], del);
+            if (generic) {
+                ht_del_hash_table(ht);
+            } else {
+                ht_u64_del_map(map);
+            }
+        }
+    }
+}
+
+
+/****** MAIN ******/
+typedef struct {
+    const char* name;
+    void (*run)(void);
+} bench_entry;
+
+static const bench_entry BENCHES[] = {
+    {"probe", bench_probe},
+    {"churn", bench_churn},
+    {"cachemiss", bench_cachemiss},
+    {"resize", bench_resize},
+    {"reserve", bench_reserve},
+    {"batch", bench_batch},
+    {"multiget", bench_multiget},
+    {"stress", bench_stress},
+    {"memory", bench_memory},
+    {"inline", bench_inline},
+    {"fastmod", bench_fastmod},
+    {"declare", bench_declare},
+    {"u64", bench_u64},
+};
+
+int main(int argc, char *argv[])
+{
+    const size_t n = sizeof(BENCHES) / sizeof(BENCHES[0]);
+    int named = 0;
+    for (int a = 1; a < argc; a++) {
+        if (strncmp(argv[a], "--max=", 6) == 0) {
+            bench_max = strtoull(argv[a] + 6, NULL, 10);
+        } else {
+            named = 1;
+        }
+    }
+    for (size_t b = 0; b < n; b++) {
+        int selected = !named;
+        for (int a = 1; a < argc; a++) {
+            selected |= strcmp(argv[a], BENCHES[b].name) == 0;
+        }
+        if (selected) {
+            BENCHES[b].run();
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,229 @@
+/**
+   Typed Hash Tables generated at compile time
+
+   HT_DECLARE(name, key_t, val_t, hash_fn, eq_fn) stamps out a table type and
+   static inline functions specialized for key_t and val_t:
+
+     name##_table* name##_new(void);
+     void    name##_del_table(name##_table* t);
+     int     name##_insert(name##_table* t, key_t key, val_t value);
+     val_t*  name##_search(name##_table* t, key_t key);
+     void    name##_delete(name##_table* t, key_t key);
+
+   hash_fn is `uint64_t hash_fn(key_t)` and eq_fn is `int eq_fn(key_t, key_t)`.
+   Both are called directly, so the compiler can inline them: there is no
+   indirect call per probe as with the callbacks of ht_config.
+   Keys and values are stored by value, as they are: the table does not copy
+   what they point to. insert returns 0, or -1 when the key is new and
+   growing the table ran out of memory (the key is not inserted).
+
+   The memory comes from HT_DECLARE_CALLOC(count, size) and HT_DECLARE_FREE(p),
+   calloc and free unless defined before this header is included.
+
+   Example:
+     HT_DECLARE(u64map, uint64_t, uint64_t, ht_hash_u64, ht_eq_u64)
+**/
+
+#ifndef HT_DECLARE_H
+#define HT_DECLARE_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "hash_table.h"
+
+#ifndef HT_DECLARE_CALLOC
+#define HT_DECLARE_CALLOC(count, size) calloc(count, size)
+#endif
+#ifndef HT_DECLARE_FREE
+#define HT_DECLARE_FREE(p) free(p)
+#endif
+
+/* Slot states stored in the hash of a generated slot */
+#define HT_DECLARE_EMPTY   0
+#define HT_DECLARE_DELETED 1
+
+
+/****** HASH AND EQUALITY HELPERS ******/
+/** 64-bit integer keys: splitmix64 finalizer, every input bit reaches every output bit **/
+static inline uint64_t ht_hash_u64(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static inline int ht_eq_u64(const uint64_t a, const uint64_t b)
+{
+    return a == b;
+}
+
+/** NUL-terminated string keys, hashed with the kernel of hash_table.c **/
+static inline uint64_t ht_hash_cstr(const char* s)
+{
+    return ht_hash_wyhash(s, strlen(s), HT_DEFAULT_SEED);
+}
+
+static inline int ht_eq_cstr(const char* a, const char* b)
+{
+    return strcmp(a, b) == 0;
+}
+
+
+/****** GENERATOR ******/
+/**
+   * Same layout as the HT_SIZE_POW2 double hashing engine of hash_table.c:
+   * cached hash per slot, power-of-two sizes, Fibonacci home bucket,
+   * triangular probing, tombstones on delete.
+   * Grows at 70% load (tombstones included; a table that is mostly
+   * tombstones is rebuilt at the same size), shrinks below 10%.
+ **/
+#define HT_DECLARE(name, key_t, val_t, hash_fn, eq_fn)                          \
+                                                                                \
+typedef struct {                                                                \
+    uint64_t hash;                                                              \
+    key_t key;                                                                  \
+    val_t value;                                                                \
+} name##_slot;                                                                  \
+                                                                                \
+typedef struct {                                                                \
+    size_t size;                                                                \
+    size_t count;                                                               \
+    size_t used;            /* count + tombstones */                            \
+    unsigned shift;         /* 64 - log2(size) */                               \
+    name##_slot* slots;                                                         \
+} name##_table;                                                                 \
+                                                                                \
+static inline uint64_t name##_hash(key_t key)                                   \
+{                                                                               \
+    const uint64_t hash = hash_fn(key);                                         \
+    return hash > HT_DECLARE_DELETED ? hash : hash + 2;                         \
+}                                                                               \
+                                                                                \
+static inline size_t name##_home(const name##_table* t, const uint64_t hash)    \
+{                                                                               \
+    return (size_t)((hash * HT_FIBONACCI) >> t->shift);                         \
+}                                                                               \
+                                                                                \
+/* slot holding key, or NULL with *free_slot set to where it goes */            \
+static inline name##_slot* name##_find(const name##_table* t,                   \
+                                       const uint64_t hash, key_t key,          \
+                                       name##_slot** free_slot)                 \
+{                                                                               \
+    const size_t mask = t->size - 1;                                            \
+    size_t index = name##_home(t, hash);                                        \
+    name##_slot* first_free = NULL;                                             \
+    for (size_t step = 1; ; step++) {                                           \
+        name##_slot* slot = &t->slots[index];                                   \
+        if (slot->hash == HT_DECLARE_EMPTY) {                                   \
+            if (free_slot != NULL) {                                            \
+                *free_slot = first_free != NULL ? first_free : slot;            \
+            }                                                                   \
+            return NULL;                                                        \
+        }                                                                       \
+        if (slot->hash == HT_DECLARE_DELETED) {                                 \
+            if (first_free == NULL) {                                           \
+                first_free = slot;                                              \
+            }                                                                   \
+        } else if (slot->hash == hash && eq_fn(slot->key, key)) {               \
+            return slot;                                                        \
+        }                                                                       \
+        index = (index + step) & mask;                                          \
+    }                                                                           \
+}                                                                               \
+                                                                                \
+static inline int name##_alloc(name##_table* t, const size_t size)              \
+{                                                                               \
+    t->slots = HT_DECLARE_CALLOC(size, sizeof(name##_slot));                    \
+    if (t->slots == NULL) return -1;                                            \
+    t->size = size;                                                             \
+    t->shift = 64;                                                              \
+    for (size_t s = 1; s < size; s <<= 1) {                                     \
+        t->shift--;                                                             \
+    }                                                                           \
+    t->count = 0;                                                               \
+    t->used = 0;                                                                \
+    return 0;                                                                   \
+}                                                                               \
+                                                                                \
+/* move every entry into a new slot array, dropping the tombstones */           \
+/* (out of memory: -1, the table keeps its current array) */                    \
+static inline int name##_rehash(name##_table* t, const size_t size)             \
+{                                                                               \
+    name##_table old = *t;                                                      \
+    if (name##_alloc(t, size) != 0) {                                           \
+        *t = old;                                                               \
+        return -1;                                                              \
+    }                                                                           \
+    for (size_t i = 0; i < old.size; i++) {                                     \
+        const name##_slot* slot = &old.slots[i];                                \
+        if (slot->hash > HT_DECLARE_DELETED) {                                  \
+            name##_slot* free_slot = NULL;                                      \
+            name##_find(t, slot->hash, slot->key, &free_slot);                  \
+            *free_slot = *slot;                                                 \
+        }                                                                       \
+    }                                                                           \
+    t->count = old.count;                                                       \
+    t->used = old.count;                                                        \
+    HT_DECLARE_FREE(old.slots);                                                 \
+    return 0;                                                                   \
+}                                                                               \
+                                                                                \
+static inline name##_table* name##_new(void)                                    \
+{                                                                               \
+    name##_table* t = HT_DECLARE_CALLOC(1, sizeof(name##_table));               \
+    if (t == NULL) return NULL;                                                 \
+    if (name##_alloc(t, 64) != 0) {                                             \
+        HT_DECLARE_FREE(t);                                                     \
+        return NULL;                                                            \
+    }                                                                           \
+    return t;                                                                   \
+}                                                                               \
+                                                                                \
+static inline void name##_del_table(name##_table* t)                            \
+{                                                                               \
+    HT_DECLARE_FREE(t->slots);                                                  \
+    HT_DECLARE_FREE(t);                                                         \
+}                                                                               \
+                                                                                \
+static inline int name##_insert(name##_table* t, key_t key, val_t value)        \
+{                                                                               \
+    /* load over 70%: purge or grow, no new key if that fails */                \
+    const int full = (t->used + 1) * 100 > t->size * 70 &&                      \
+        name##_rehash(t, t->count * 2 < t->used ? t->size : t->size * 2) != 0;  \
+    const uint64_t hash = name##_hash(key);                                     \
+    name##_slot* free_slot = NULL;                                              \
+    name##_slot* slot = name##_find(t, hash, key, &free_slot);                  \
+    if (slot != NULL) {                                                         \
+        slot->value = value;                                                    \
+        return 0;                                                               \
+    }                                                                           \
+    if (full) return -1;                                                        \
+    t->used += free_slot->hash == HT_DECLARE_EMPTY;                             \
+    free_slot->hash = hash;                                                     \
+    free_slot->key = key;                                                       \
+    free_slot->value = value;                                                   \
+    t->count++;                                                                 \
+    return 0;                                                                   \
+}                                                                               \
+                                                                                \
+static inline val_t* name##_search(name##_table* t, key_t key)                  \
+{                                                                               \
+    name##_slot* slot = name##_find(t, name##_hash(key), key, NULL);            \
+    return slot != NULL ? &slot->value : NULL;                                  \
+}                                                                               \
+                                                                                \
+static inline void name##_delete(name##_table* t, key_t key)                    \
+{                                                                               \
+    name##_slot* slot = name##_find(t, name##_hash(key), key, NULL);            \
+    if (slot == NULL) return;                                                   \
+    slot->hash = HT_DECLARE_DELETED;                                            \
+    t->count--;                                                                 \
+    if (t->size > 64 && t->count * 100 < t->size * 10) {                        \
+        name##_rehash(t, t->size / 2);                                          \
+    }                                                                           \
+}
+
+#endif
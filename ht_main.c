@@ -1,12 +1,707 @@
-/* -*- compile-command: "gcc -Wall -pedantic -g3 ht_main.c -o ht_main" -*- */
+/* -*- compile-command: "gcc -Wall -pedantic -g3 ht_main.c hash_table.c prime.c ht_arena.c ht_u64.c -o ht_main" -*- */
+/**
+   Tests of the Hash Table: random inserts, deletes, updates and searches
+   checked against a reference array, for every engine, sizing and resize mode
+**/
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "hash_table.h"
+#include "ht_u64.h"
 
-int main(int argc, char *argv[]) {
+// typed tables of the tests take their memory from the test allocator
+#define HT_DECLARE_CALLOC(count, size) test_alloc_zeroed(NULL, count, size)
+#define HT_DECLARE_FREE(p) test_free(NULL, p)
+#include "ht_declare.h"
+
+#define TEST_KEYS  2000
+#define TEST_OPS   200000
+#define TEST_CHECK 5000      // full comparison every TEST_CHECK operations
+#define TEST_PHASE 10000     // operations between a filling and a draining phase
+
+#define CHECK(cond) do {                                                    \
+        if (!(cond)) {                                                      \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            exit(EXIT_FAILURE);                                             \
+        }                                                                   \
+    } while (0)
+
+// Allocator counting its live blocks, failing once its budget is spent
+static long test_live;          // blocks allocated and not freed yet
+static long test_budget = -1;   // allocations left before they fail, -1 unlimited
+
+static void* test_alloc(void* ctx, size_t size)
+{
+    (void)ctx;
+    if (test_budget == 0) return NULL;
+    test_budget -= test_budget > 0;
+    void* p = malloc(size);
+    test_live += p != NULL;
+    return p;
+}
+
+static void* test_alloc_zeroed(void* ctx, size_t count, size_t size)
+{
+    void* p = test_alloc(ctx, count * size);
+    return p != NULL ? memset(p, 0, count * size) : NULL;
+}
+
+static void test_free(void* ctx, void* p)
+{
+    (void)ctx;
+    test_live -= p != NULL;
+    free(p);
+}
+
+static const ht_allocator TEST_ALLOCATOR = {test_alloc, test_alloc_zeroed, test_free, NULL};
+
+HT_DECLARE(test_map, uint64_t, uint64_t, ht_hash_u64, ht_eq_u64)
+
+// Reference: the value of every key of the universe, or absent
+typedef struct {
+    int present[TEST_KEYS];
+    unsigned gen[TEST_KEYS];      // bumped by a delete: the next insert is a fresh key
+    char value[TEST_KEYS][24];
+    size_t count;
+} test_model;
+
+static uint64_t test_rand(uint64_t* s)
+{
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+static void test_key(char* buf, const test_model* m, const size_t i)
+{
+    // short and long keys: inline and heap copies both
+    snprintf(buf, 32, i % 2 ? "k%zu.%u" : "key-number-%zu.%u", i, m->gen[i]);
+}
+
+/* Every key of the universe is found with its value, or missing */
+static void test_compare(ht_hash_table* ht, const test_model* m)
+{
+    char key[32];
+    CHECK(ht->count == m->count);
+    for (size_t i = 0; i < TEST_KEYS; i++) {
+        test_key(key, m, i);
+        const char* v = ht_search(ht, key);
+        CHECK((v != NULL) == m->present[i]);
+        CHECK(v == NULL || strcmp(v, m->value[i]) == 0);
+    }
+}
+
+/**
+   * Random operations on one table, checked against the model. Phases
+   * that mostly insert alternate with phases that mostly delete, so the
+   * tables grow and fill with tombstones.
+   * Returns the deletes done while a resize was draining the old array.
+ **/
+static size_t test_run(const ht_config* cfg)
+{
+    static test_model m;
+    memset(&m, 0, sizeof(m));
+    ht_hash_table* ht = ht_new_ex(cfg);
+    CHECK(ht != NULL);
+    uint64_t seed = 88172645463325252ULL;
+    char key[32], value[24];
+    size_t old_deletes = 0;
+
+    for (size_t r = 0; r < TEST_OPS; r++) {
+        const size_t i = test_rand(&seed) % TEST_KEYS;
+        // filling: 50% inserts, 20% deletes; draining: 20% inserts, 50% deletes
+        const unsigned fill = (r / TEST_PHASE) % 2 == 0 ? 30 : 0;
+        const unsigned op = test_rand(&seed) % 100;
+        test_key(key, &m, i);
+        snprintf(value, sizeof(value), "v%zu", r % 1000 ? r : r * 1000000);
+
+        if (op < 20 + fill) {
+            CHECK(ht_insert(ht, key, value) == 0);
+            m.count += !m.present[i];
+            m.present[i] = 1;
+            strcpy(m.value[i], value);
+        } else if (op < 70) {
+            old_deletes += ht->old != NULL;
+            ht_delete(ht, key);
+            m.count -= m.present[i];
+            m.present[i] = 0;
+            m.gen[i]++;
+        } else if (op < 85) {
+            CHECK(ht_update(ht, key, value) == m.present[i]);
+            if (m.present[i]) {
+                strcpy(m.value[i], value);
+            }
+        } else {
+            int inserted;
+            const char* v = ht_find_or_insert(ht, key, value, &inserted);
+            CHECK(v != NULL && inserted == !m.present[i]);
+            if (inserted) {
+                m.count++;
+                m.present[i] = 1;
+                strcpy(m.value[i], value);
+            }
+            CHECK(strcmp(v, m.value[i]) == 0);
+        }
+
+        test_key(key, &m, i);
+        const char* v = ht_search(ht, key);
+        CHECK((v != NULL) == m.present[i]);
+        CHECK(v == NULL || strcmp(v, m.value[i]) == 0);
+        if (r % TEST_CHECK == 0) {
+            test_compare(ht, &m);
+        }
+    }
+    test_compare(ht, &m);
+    ht_del_hash_table(ht);
+    return old_deletes;
+}
+
+/**
+   * Fill a table up to its grow load, delete half of it and insert new keys:
+   * once the tombstones push it over the grow load, the table must purge
+   * them in place (same size, no tombstone left) and keep every live key.
+ **/
+static void test_purge(const ht_config* cfg)
+{
+    ht_hash_table* ht = ht_new_ex(cfg);
+    CHECK(ht != NULL && ht_reserve(ht, 1000) == 0);
+    const size_t size = ht->size;
+    char key[32];
+    size_t n = 0;
+
+    for (; (ht->count + 1) * 100 <= size * cfg->grow_load; n++) {
+        snprintf(key, sizeof(key), "purge-%zu", n);
+        CHECK(ht_insert(ht, key, key) == 0);
+    }
+    for (size_t i = 0; i < n; i += 2) {
+        snprintf(key, sizeof(key), "purge-%zu", i);
+        ht_delete(ht, key);
+    }
+    const size_t first = n;
+    while (ht->deleted > 0 && ht->count * 2 < size) {
+        snprintf(key, sizeof(key), "purge-%zu", n++);
+        CHECK(ht_insert(ht, key, key) == 0);
+    }
+    CHECK(ht->deleted == 0 && ht->size == size);
+    for (size_t i = 0; i < n; i++) {
+        snprintf(key, sizeof(key), "purge-%zu", i);
+        const char* v = ht_search(ht, key);
+        CHECK((v != NULL) == (i % 2 == 1 || i >= first));
+        CHECK(v == NULL || strcmp(v, key) == 0);
+    }
+    ht_del_hash_table(ht);
+}
+
+/**
+   * Reserve room for capacity entries under non-default load thresholds,
+   * fill it and delete everything: the shrinks on the way down start from
+   * sizes off the ladder of plain doublings and must still fit the entries.
+ **/
+static void test_shrink(const ht_config* base, const unsigned grow_load,
+                        const unsigned shrink_load, const size_t capacity)
+{
+    ht_config cfg = *base;
+    cfg.grow_load = grow_load;
+    cfg.shrink_load = shrink_load;
+    ht_hash_table* ht = ht_new_ex(&cfg);
+    CHECK(ht != NULL && ht_reserve(ht, capacity) == 0);
+    const size_t size = ht->size;
+    char key[32];
+
+    for (size_t i = 0; i < capacity; i++) {
+        snprintf(key, sizeof(key), "shrink-%zu", i);
+        CHECK(ht_insert(ht, key, key) == 0);
+    }
+    CHECK(ht->size == size);
+    for (size_t i = 0; i < capacity; i++) {
+        snprintf(key, sizeof(key), "shrink-%zu", i);
+        ht_delete(ht, key);
+        CHECK(ht->count == capacity - i - 1);
+        CHECK(ht->count * 100 <= ht->size * grow_load);
+        if (i + 1 < capacity) {
+            snprintf(key, sizeof(key), "shrink-%zu", capacity - 1);
+            CHECK(ht_search(ht, key) != NULL);
+        }
+    }
+    CHECK(ht->size < size);
+    ht_del_hash_table(ht);
+}
+
+/**
+   * Every allocation of a run of inserts, updates and find_or_inserts fails
+   * from the budget-th on: a refused operation must leave the table as it
+   * was, and nothing may leak. Then a taken key whose value copy fails
+   * must be left to the caller.
+ **/
+static void test_oom(const ht_config* base)
+{
+    ht_config cfg = *base;
+    cfg.allocator = &TEST_ALLOCATOR;
+    char key[32], value[32];
+    size_t failed = 1;
+
+    for (long budget = 0; failed > 0; budget++) {
+        static char model[200][32];
+        ht_hash_table* ht = ht_new_ex(&cfg);
+        CHECK(ht != NULL);
+        memset(model, 0, sizeof(model));
+        test_budget = budget;
+        failed = 0;
+        for (size_t r = 0; r < 600; r++) {
+            const size_t i = r * 7 % 200;
+            snprintf(key, sizeof(key), i % 2 ? "oom-%zu" : "oom-long-key-%zu", i);
+            snprintf(value, sizeof(value), "oom-value-%zu", r);
+            if (r % 3 == 0) {
+                if (ht_insert(ht, key, value) == 0) {
+                    strcpy(model[i], value);
+                } else {
+                    failed++;
+                }
+            } else if (r % 3 == 1) {
+                const int updated = ht_update(ht, key, value);
+                CHECK(updated == (model[i][0] != '\0') || updated == -1);
+                if (updated == 1) {
+                    strcpy(model[i], value);
+                }
+                failed += updated == -1;
+            } else {
+                int inserted;
+                const char* v = ht_find_or_insert(ht, key, value, &inserted);
+                if (model[i][0] != '\0') {
+                    CHECK(v != NULL && !inserted && strcmp(v, model[i]) == 0);
+                } else if (v != NULL) {
+                    CHECK(inserted);
+                    strcpy(model[i], value);
+                } else {
+                    failed++;
+                }
+            }
+        }
+        test_budget = -1;
+        for (size_t i = 0; i < 200; i++) {
+            snprintf(key, sizeof(key), i % 2 ? "oom-%zu" : "oom-long-key-%zu", i);
+            const char* v = ht_search(ht, key);
+            CHECK(model[i][0] == '\0' ? v == NULL : v != NULL && strcmp(v, model[i]) == 0);
+        }
+        ht_del_hash_table(ht);
+        CHECK(test_live == 0);
+    }
 
-    ht_hash_table* ht = ht_new();
+    cfg.key_own = HT_OWN_TAKE;
+    ht_hash_table* ht = ht_new_ex(&cfg);
+    CHECK(ht != NULL);
+    char* taken = test_alloc(NULL, 16);
+    strcpy(taken, "taken-key");
+    test_budget = 0;
+    CHECK(ht_insert(ht, taken, "a value too long to be inline") == -1);
+    CHECK(ht_find_or_insert(ht, taken, "a value too long to be inline", NULL) == NULL);
+    test_budget = -1;
+    CHECK(ht->count == 0);
+    test_free(NULL, taken);
     ht_del_hash_table(ht);
+    CHECK(test_live == 0);
+}
+
+/**
+   * Grow a table reserved for capacity entries, a size off the ladder of
+   * plain doublings: every grow must about double the slots, no more.
+ **/
+static void test_grow(const ht_config* cfg, const size_t capacity)
+{
+    ht_hash_table* ht = ht_new_ex(cfg);
+    CHECK(ht != NULL && ht_reserve(ht, capacity) == 0);
+    size_t size = ht->size;
+    char key[32];
+
+    for (size_t i = 0; i < 20 * capacity; i++) {
+        snprintf(key, sizeof(key), "grow-%zu", i);
+        CHECK(ht_insert(ht, key, key) == 0);
+        if (ht->size != size) {
+            CHECK(ht->size * 2 > size * 3 && ht->size * 2 < size * 5);
+            size = ht->size;
+        }
+    }
+    CHECK(ht->count == 20 * capacity);
+    ht_del_hash_table(ht);
+}
+
+/**
+   * ht_search_batch against ht_search, key by key, for hits, misses and
+   * deleted keys, in batches of several sizes; with incremental_resize,
+   * the first batches run while the old array is still being drained.
+ **/
+static void test_search_batch(const ht_config* cfg)
+{
+    enum { N = 3000 };
+    static char keys[N][32];
+    static const void* batch[N];
+    static void* values[N];
+    static char found[N][32];   // values[i] copied: an inline value moves with its slot
+    ht_hash_table* ht = ht_new_ex(cfg);
+    CHECK(ht != NULL);
+
+    for (size_t i = 0; i < N; i++) {
+        // short and long keys; a third never inserted, a third deleted
+        snprintf(keys[i], sizeof(keys[i]), i % 2 ? "b%zu" : "batch-key-%zu", i);
+        batch[i] = keys[i];
+        if (i % 3 != 0) {
+            CHECK(ht_insert(ht, keys[i], keys[i]) == 0);
+        }
+    }
+    for (size_t i = 2; i < N; i += 3) {
+        ht_delete(ht, keys[i]);
+    }
+    // a resize in progress: insert other keys until one starts
+    char key[32];
+    for (size_t i = 0; cfg->incremental_resize && ht->old == NULL; i++) {
+        snprintf(key, sizeof(key), "batch-other-%zu", i);
+        CHECK(ht_insert(ht, key, key) == 0);
+    }
+
+    const size_t sizes[] = {1, 7, 64, 100, 1000, N};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (size_t first = 0; first < N; first += sizes[s]) {
+            const size_t n = N - first < sizes[s] ? N - first : sizes[s];
+            ht_search_batch(ht, batch + first, values + first, n);
+            for (size_t i = first; i < first + n; i++) {
+                snprintf(found[i], sizeof(found[i]), "%s", values[i] ? (char*)values[i] : "");
+            }
+        }
+        for (size_t i = 0; i < N; i++) {
+            const char* v = ht_search(ht, keys[i]);
+            CHECK(strcmp(found[i], v != NULL ? v : "") == 0);
+            CHECK((v != NULL) == (i % 3 == 1));
+        }
+    }
+    ht_del_hash_table(ht);
+}
+
+/**
+   * ht_insert_batch against one ht_insert per pair: batches of random sizes
+   * with keys repeated inside a batch (the last value wins) and deletes in
+   * between, so that batches also land during resizes and on tombstones.
+ **/
+static void test_insert_batch(const ht_config* cfg)
+{
+    enum { K = 1500, B = 300 };
+    static char keys[B][32], values[B][32];
+    static const void* kp[B];
+    static const void* vp[B];
+    ht_hash_table* ht = ht_new_ex(cfg);
+    ht_hash_table* ref = ht_new_ex(cfg);
+    CHECK(ht != NULL && ref != NULL);
+    uint64_t seed = 2463534242ULL;
+    char key[32];
+
+    for (size_t r = 0; r < 100; r++) {
+        const size_t n = test_rand(&seed) % B + 1;
+        for (size_t j = 0; j < n; j++) {
+            const size_t i = test_rand(&seed) % (K / 10 + r * 10);
+            snprintf(keys[j], sizeof(keys[j]), i % 2 ? "ib%zu" : "insert-batch-%zu", i);
+            snprintf(values[j], sizeof(values[j]), "%zu-%zu", r, j);
+            kp[j] = keys[j];
+            vp[j] = values[j];
+            CHECK(ht_insert(ref, keys[j], values[j]) == 0);
+        }
+        CHECK(ht_insert_batch(ht, kp, vp, n) == 0);
+        for (size_t j = 0; j < n; j += 3) {
+            ht_delete(ht, keys[j]);
+            ht_delete(ref, keys[j]);
+        }
+        CHECK(ht->count == ref->count);
+    }
+    for (size_t i = 0; i < K; i++) {
+        snprintf(key, sizeof(key), i % 2 ? "ib%zu" : "insert-batch-%zu", i);
+        const char* v = ht_search(ht, key);
+        const char* w = ht_search(ref, key);
+        CHECK((v != NULL) == (w != NULL));
+        CHECK(v == NULL || strcmp(v, w) == 0);
+    }
+    ht_del_hash_table(ht);
+    ht_del_hash_table(ref);
+}
+
+/**
+   * Integer map against a model: random inserts, deletes (backward shifts)
+   * and searches over keys that include 0 (kept outside the slot array).
+   * Then its allocator fails: a new key is refused once the map would need
+   * to grow, an existing key is still updated, and nothing leaks.
+ **/
+static void test_u64(void)
+{
+    enum { K = 3000 };
+    static uint64_t keys[K], values[K];
+    static int present[K];
+    uint64_t seed = 1181783497276652981ULL;
+    size_t count = 0;
+    ht_u64_map* map = ht_u64_new_ex(&TEST_ALLOCATOR);
+    CHECK(map != NULL);
+
+    for (size_t i = 0; i < K; i++) {
+        // key 0, small keys and scattered ones
+        keys[i] = i < K / 2 ? i : test_rand(&seed);
+        present[i] = 0;
+    }
+    for (size_t r = 0; r < 300000; r++) {
+        const size_t i = test_rand(&seed) % ((r / 30000) % 2 ? K / 4 : K);
+        if (test_rand(&seed) % 100 < 55) {
+            CHECK(ht_u64_insert(map, keys[i], r) == 0);
+            count += !present[i];
+            present[i] = 1;
+            values[i] = r;
+        } else {
+            ht_u64_delete(map, keys[i]);
+            count -= present[i];
+            present[i] = 0;
+        }
+        CHECK(map->count == count);
+        if (r % 10000 == 0) {
+            for (size_t j = 0; j < K; j++) {
+                const uint64_t* v = ht_u64_search(map, keys[j]);
+                CHECK((v != NULL) == present[j] && (v == NULL || *v == values[j]));
+            }
+        }
+    }
+
+    test_budget = 0;
+    size_t refused = 0;
+    for (size_t i = 0; i < K; i++) {
+        if (ht_u64_insert(map, keys[i], i) == 0) {
+            count += !present[i];
+            present[i] = 1;
+            values[i] = i;
+        } else {
+            CHECK(!present[i]);
+            refused++;
+        }
+    }
+    test_budget = -1;
+    CHECK(refused > 0 && map->count == count);
+    CHECK((map->count - map->has_zero) * 100 <= map->size * 70 + 100);
+    for (size_t j = 0; j < K; j++) {
+        const uint64_t* v = ht_u64_search(map, keys[j]);
+        CHECK((v != NULL) == present[j] && (v == NULL || *v == values[j]));
+    }
+    ht_u64_del_map(map);
+    CHECK(test_live == 0);
+}
+
+/**
+   * Typed table of HT_DECLARE against a model: a deleted key comes back as
+   * a new one, so tombstones pile up, get reused and are dropped by
+   * rehashes at the same size. Then its allocation fails: a new key is
+   * refused at the grow threshold, an existing one is still updated.
+ **/
+static void test_declare(void)
+{
+    enum { K = 2000 };
+    static uint64_t gen[K], values[K];
+    static int present[K];
+    uint64_t seed = 0x2545f4914f6cdd1dULL;
+    size_t count = 0, reused = 0, purges = 0;
+    test_map_table* t = test_map_new();
+    CHECK(t != NULL);
+    memset(gen, 0, sizeof(gen));
+    memset(present, 0, sizeof(present));
+
+    for (size_t r = 0; r < 300000; r++) {
+        const size_t i = test_rand(&seed) % K;
+        const uint64_t key = gen[i] << 32 | i;
+        const size_t size = t->size, used = t->used;
+        if (test_rand(&seed) % 100 < 50) {
+            CHECK(test_map_insert(t, key, r) == 0);
+            reused += !present[i] && t->size == size && t->used == used;
+            purges += t->size == size && t->used < used;
+            count += !present[i];
+            present[i] = 1;
+            values[i] = r;
+        } else {
+            test_map_delete(t, key);
+            count -= present[i];
+            gen[i] += present[i];
+            present[i] = 0;
+        }
+        CHECK(t->count == count);
+        if (r % 10000 == 0) {
+            for (size_t j = 0; j < K; j++) {
+                const uint64_t* v = test_map_search(t, gen[j] << 32 | j);
+                CHECK((v != NULL) == present[j] && (v == NULL || *v == values[j]));
+            }
+        }
+    }
+    CHECK(reused > 0 && purges > 0);
+
+    test_budget = 0;
+    size_t added = 0, refused = 0;
+    for (uint64_t n = 0; n < 4 * K; n++) {
+        if (test_map_insert(t, 1ULL << 63 | n, n) == 0) {
+            CHECK(refused == 0);
+            added++;
+        } else {
+            refused++;
+        }
+    }
+    for (size_t i = 0; i < K; i++) {
+        if (present[i]) {
+            CHECK(test_map_insert(t, gen[i] << 32 | i, i) == 0);
+            values[i] = i;
+        }
+    }
+    test_budget = -1;
+    CHECK(refused > 0 && t->count == count + added && t->used * 100 <= t->size * 70 + 100);
+    for (size_t j = 0; j < K; j++) {
+        const uint64_t* v = test_map_search(t, gen[j] << 32 | j);
+        CHECK((v != NULL) == present[j] && (v == NULL || *v == values[j]));
+    }
+    for (uint64_t n = 0; n < 4 * K; n++) {
+        CHECK((test_map_search(t, 1ULL << 63 | n) != NULL) == (n < added));
+    }
+    test_map_del_table(t);
+    CHECK(test_live == 0);
+}
+
+// Buffers lent to a table (HT_OWN_BORROW): freed once the table is gone
+static void* test_lent[8192];
+static size_t test_nlent;
+
+static char* test_strdup(const char* s)
+{
+    char* d = test_alloc(NULL, strlen(s) + 1);
+    CHECK(d != NULL);
+    return strcpy(d, s);
+}
+
+/* p was stored by the table: a copied one is freed, a borrowed one outlives
+   the table, a taken one is the table's */
+static void test_hand_over(const ht_ownership own, char* p)
+{
+    if (own == HT_OWN_COPY) {
+        test_free(NULL, p);
+    } else if (own == HT_OWN_BORROW) {
+        CHECK(test_nlent < sizeof(test_lent) / sizeof(test_lent[0]));
+        test_lent[test_nlent++] = p;
+    }
+}
+
+/**
+   * Every pair of key and value ownership policies, every key and value
+   * passed in its own allocation: inserts (new and existing keys), updates,
+   * find_or_inserts (hits release taken key and value) and deletes, checked
+   * against a model; every block must be freed once, by the table or here.
+ **/
+static void test_ownership(const ht_config* base)
+{
+    enum { K = 300 };
+    static char model[K][32];
+    char buf[32];
+
+    for (int key_own = HT_OWN_COPY; key_own <= HT_OWN_TAKE; key_own++) {
+        for (int value_own = HT_OWN_COPY; value_own <= HT_OWN_TAKE; value_own++) {
+            ht_config cfg = *base;
+            cfg.allocator = &TEST_ALLOCATOR;
+            cfg.key_own = (ht_ownership)key_own;
+            cfg.value_own = (ht_ownership)value_own;
+            ht_hash_table* ht = ht_new_ex(&cfg);
+            CHECK(ht != NULL);
+            memset(model, 0, sizeof(model));
+            uint64_t seed = 0x9e3779b97f4a7c15ULL;
+            test_nlent = 0;
+
+            for (size_t r = 0; r < 3000; r++) {
+                const size_t i = test_rand(&seed) % K;
+                snprintf(buf, sizeof(buf), i % 2 ? "o%zu" : "ownership-key-%zu", i);
+                char* key = test_strdup(buf);
+                snprintf(buf, sizeof(buf), r % 2 ? "v%zu" : "ownership-value-%zu", r);
+                char* value = test_strdup(buf);
+                const unsigned op = test_rand(&seed) % 4;
+                if (op == 0) {
+                    CHECK(ht_insert(ht, key, value) == 0);
+                    strcpy(model[i], buf);
+                    test_hand_over(cfg.key_own, key);
+                    test_hand_over(cfg.value_own, value);
+                } else if (op == 1) {
+                    const int updated = ht_update(ht, key, value);
+                    CHECK(updated == (model[i][0] != '\0'));
+                    test_free(NULL, key);
+                    if (updated) {
+                        strcpy(model[i], buf);
+                        test_hand_over(cfg.value_own, value);
+                    } else {
+                        test_free(NULL, value);
+                    }
+                } else if (op == 2) {
+                    int inserted;
+                    const char* v = ht_find_or_insert(ht, key, value, &inserted);
+                    CHECK(v != NULL && inserted == (model[i][0] == '\0'));
+                    if (inserted) {
+                        strcpy(model[i], buf);
+                        test_hand_over(cfg.key_own, key);
+                        test_hand_over(cfg.value_own, value);
+                    } else {
+                        CHECK(strcmp(v, model[i]) == 0);
+                        if (cfg.key_own != HT_OWN_TAKE) test_free(NULL, key);
+                        if (cfg.value_own != HT_OWN_TAKE) test_free(NULL, value);
+                    }
+                } else {
+                    ht_delete(ht, key);
+                    model[i][0] = '\0';
+                    test_free(NULL, key);
+                    test_free(NULL, value);
+                }
+                snprintf(buf, sizeof(buf), i % 2 ? "o%zu" : "ownership-key-%zu", i);
+                const char* v = ht_search(ht, buf);
+                CHECK(model[i][0] == '\0' ? v == NULL : v != NULL && strcmp(v, model[i]) == 0);
+            }
+            ht_del_hash_table(ht);
+            for (size_t j = 0; j < test_nlent; j++) {
+                test_free(NULL, test_lent[j]);
+            }
+            CHECK(test_live == 0);
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+
+    const char* probes[] = {"double", "group", "robin_hood"};
+    (void)argc;
+    (void)argv;
+
+    for (int probe = HT_PROBE_DOUBLE; probe <= HT_PROBE_ROBIN_HOOD; probe++) {
+        for (int sizing = HT_SIZE_PRIME; sizing <= HT_SIZE_POW2; sizing++) {
+            for (int incremental = 0; incremental <= 1; incremental++) {
+                ht_config cfg;
+                ht_config_init(&cfg);
+                cfg.probe = (ht_probe_mode)probe;
+                cfg.sizing = (ht_size_mode)sizing;
+                cfg.incremental_resize = incremental;
+                const size_t old_deletes = test_run(&cfg);
+                CHECK(!incremental || old_deletes > 0);
+                if (probe != HT_PROBE_ROBIN_HOOD && !incremental) {
+                    test_purge(&cfg);   // Robin Hood has no tombstones
+                }
+                test_search_batch(&cfg);
+                test_insert_batch(&cfg);
+                test_oom(&cfg);
+                test_ownership(&cfg);
+                test_grow(&cfg, 71);
+                test_grow(&cfg, 90);
+                test_shrink(&cfg, 70, 30, 72);
+                test_shrink(&cfg, 70, 30, 90);
+                test_shrink(&cfg, 95, 50, 96);
+                printf("%-10s %-5s %-11s ok (%zu deletes during a resize)\n",
+                       probes[probe], sizing == HT_SIZE_POW2 ? "pow2" : "prime",
+                       incremental ? "incremental" : "at once", old_deletes);
+            }
+        }
+    }
+
+    test_u64();
+    printf("u64 map ok\n");
+    test_declare();
+    printf("HT_DECLARE table ok\n");
 
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,201 @@
+/* -*- compile-command: "gcc -Wall -pedantic -g3 -c ht_u64.c" -*- */
+/**
+   Hash Table specialized for 64-bit integer keys and values
+   Open addressing over 16-byte slots: no hash is cached (the key is its own
+   hash input), no key or value is allocated, the empty state is the reserved
+   key HT_U64_EMPTY, and key 0 itself lives in map->zero_value.
+   Linear probing from a Fibonacci home bucket, backward-shift delete.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "ht_u64.h"
+
+static int ht_u64_resize(ht_u64_map* map, size_t size);
+
+
+/******* ADD *******/
+/* Memory of the map: its allocator, or calloc/free */
+static void* ht_u64_calloc(const ht_allocator* a, const size_t count, const size_t size)
+{
+    return a != NULL ? a->alloc_zeroed(a->ctx, count, size) : calloc(count, size);
+}
+
+static void ht_u64_free(const ht_allocator* a, void* p)
+{
+    if (a != NULL) {
+        a->free(a->ctx, p);
+    } else {
+        free(p);
+    }
+}
+
+/**
+   #Internal
+   * Allocate an empty slot array of size buckets (a power of two)
+   @return 0, -1 if out of memory (map left untouched)
+ **/
+static int ht_u64_alloc(ht_u64_map* map, const size_t size)
+{
+    // zeroed: every slot starts as HT_U64_EMPTY
+    ht_u64_slot* slots = ht_u64_calloc(map->allocator, size, sizeof(ht_u64_slot));
+    if (slots == NULL) return -1;
+    map->slots = slots;
+    map->size = size;
+    map->shift = 64;
+    for (size_t s = 1; s < size; s <<= 1) {
+        map->shift--;
+    }
+    return 0;
+}
+
+/** Create a new integer Hash Table **/
+ht_u64_map* ht_u64_new(void)
+{
+    return ht_u64_new_ex(NULL);
+}
+
+/** Create a new integer Hash Table on an allocator **/
+ht_u64_map* ht_u64_new_ex(const ht_allocator* allocator)
+{
+    ht_u64_map* map = ht_u64_calloc(allocator, 1, sizeof(ht_u64_map));
+    if (map == NULL) return NULL;
+    map->allocator = allocator;
+    if (ht_u64_alloc(map, HT_U64_INITIAL_SIZE) != 0) {
+        ht_u64_free(allocator, map);
+        return NULL;
+    }
+    map->count = 0;
+    map->has_zero = 0;
+    map->zero_value = 0;
+    return map;
+}
+
+
+/******** REMOVE *********/
+/** Free memory allocated for the integer Hash Table **/
+void ht_u64_del_map(ht_u64_map* map)
+{
+    ht_u64_free(map->allocator, map->slots);
+    ht_u64_free(map->allocator, map);
+}
+
+
+/****** LOOKUP ******/
+/**
+   #Internal
+   * Home bucket: Fibonacci (multiply-shift) reduction of the key,
+   * whose top bits depend on every bit of the key
+ **/
+static inline size_t ht_u64_home(const ht_u64_map* map, const uint64_t key)
+{
+    return (size_t)((key * HT_FIBONACCI) >> map->shift);
+}
+
+/**
+   #Internal
+   * Linear probe for a non zero key
+   @return the slot holding key, or the empty slot where it goes
+ **/
+static inline size_t ht_u64_probe(const ht_u64_map* map, const uint64_t key)
+{
+    const size_t mask = map->size - 1;
+    size_t index = ht_u64_home(map, key);
+    while (map->slots[index].key != key && map->slots[index].key != HT_U64_EMPTY) {
+        index = (index + 1) & mask;
+    }
+    return index;
+}
+
+
+/****** INSERT ******/
+int ht_u64_insert(ht_u64_map* map, const uint64_t key, const uint64_t value)
+{
+    if (key == HT_U64_EMPTY) {
+        map->count += !map->has_zero;
+        map->has_zero = 1;
+        map->zero_value = value;
+        return 0;
+    }
+    // load of the slot array above 70%: grow, or take no new key if that fails
+    const int full = (map->count - map->has_zero + 1) * 100 > map->size * 70 &&
+        ht_u64_resize(map, map->size * 2) != 0;
+    ht_u64_slot* slot = &map->slots[ht_u64_probe(map, key)];
+    if (slot->key == HT_U64_EMPTY) {
+        if (full) {
+            return -1;
+        }
+        map->count++;
+    }
+    slot->key = key;
+    slot->value = value;
+    return 0;
+}
+
+
+/****** SEARCH ******/
+uint64_t* ht_u64_search(ht_u64_map* map, const uint64_t key)
+{
+    if (key == HT_U64_EMPTY) {
+        return map->has_zero ? &map->zero_value : NULL;
+    }
+    ht_u64_slot* slot = &map->slots[ht_u64_probe(map, key)];
+    return slot->key == key ? &slot->value : NULL;
+}
+
+
+/****** DELETE ******/
+void ht_u64_delete(ht_u64_map* map, const uint64_t key)
+{
+    if (key == HT_U64_EMPTY) {
+        map->count -= map->has_zero;
+        map->has_zero = 0;
+        return;
+    }
+    const size_t mask = map->size - 1;
+    size_t hole = ht_u64_probe(map, key);
+    if (map->slots[hole].key == HT_U64_EMPTY) {
+        return;
+    }
+    map->count--;
+
+    // shift back every following entry of the run whose home is not
+    // between the hole and its own slot (it would become unreachable)
+    for (size_t index = (hole + 1) & mask; map->slots[index].key != HT_U64_EMPTY;
+         index = (index + 1) & mask) {
+        const size_t home = ht_u64_home(map, map->slots[index].key);
+        if (((index - home) & mask) >= ((index - hole) & mask)) {
+            map->slots[hole] = map->slots[index];
+            hole = index;
+        }
+    }
+    map->slots[hole].key = HT_U64_EMPTY;
+
+    // load below 10%: shrink
+    if (map->size > HT_U64_INITIAL_SIZE && map->count * 100 < map->size * 10) {
+        ht_u64_resize(map, map->size / 2);
+    }
+}
+
+
+/****** RESIZE ******/
+/**
+   #Internal
+   * Move every entry into a new slot array of size buckets.
+   * Out of memory: the map keeps its current array and -1 is returned.
+ **/
+static int ht_u64_resize(ht_u64_map* map, const size_t size)
+{
+    ht_u64_slot* old = map->slots;
+    const size_t old_size = map->size;
+    if (ht_u64_alloc(map, size) != 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < old_size; i++) {
+        if (old[i].key != HT_U64_EMPTY) {
+            map->slots[ht_u64_probe(map, old[i].key)] = old[i];
+        }
+    }
+    ht_u64_free(map->allocator, old);
+    return 0;
+}
@@ -0,0 +1,84 @@
+/**
+   Hash Table specialized for 64-bit integer keys and values
+**/
+
+#ifndef HT_U64_H
+#define HT_U64_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "hash_table.h"   // ht_allocator, HT_FIBONACCI
+
+#define HT_U64_INITIAL_SIZE 64
+
+/* Key marking an empty slot: key 0 itself is kept outside the slot array */
+#define HT_U64_EMPTY 0
+
+
+// Slot: 16 bytes, four per cache line
+typedef struct {
+    uint64_t key;
+    uint64_t value;
+} ht_u64_slot;
+
+
+// Integer Hash Table
+typedef struct {
+    size_t size;           // power of two
+    size_t count;          // entries, key 0 included
+    unsigned shift;        // 64 - log2(size)
+    ht_u64_slot* slots;
+    int has_zero;          // key 0 is present
+    uint64_t zero_value;   // its value
+    const ht_allocator* allocator; // memory of the map (NULL: calloc/free)
+} ht_u64_map;
+
+
+
+/**
+   Create a new integer Hash Table
+   @return ht_u64_map Hash Table, NULL if out of memory
+ **/
+ht_u64_map* ht_u64_new(void);
+
+/**
+   Create a new integer Hash Table whose memory comes from allocator
+   @param ht_allocator* allocator: the allocator (NULL: calloc/free)
+   @return ht_u64_map Hash Table, NULL if out of memory
+ **/
+ht_u64_map* ht_u64_new_ex(const ht_allocator* allocator);
+
+/**
+   Free memory allocated for the integer Hash Table
+   @param ht_u64_map* map: the Hash Table
+ **/
+void ht_u64_del_map(ht_u64_map* map);
+
+/**
+   Insert a key-value pair, replacing the value of an existing key
+   @param ht_u64_map* map: the Hash Table
+   @param uint64_t key: the key (any value)
+   @param uint64_t value: the value
+   @return 0, -1 if the key is new and growing the table ran out of memory
+           (the key is not inserted)
+ **/
+int ht_u64_insert(ht_u64_map* map, uint64_t key, uint64_t value);
+
+/**
+   Search an element by its key
+   @param ht_u64_map* map: the Hash Table
+   @param uint64_t key: the key
+   @return a pointer to the stored value, NULL if missing
+           (valid until the next insert or delete)
+ **/
+uint64_t* ht_u64_search(ht_u64_map* map, uint64_t key);
+
+/**
+   Delete an element by its key
+   NOTE: linear probing, the following items are shifted back (no tombstones)
+   @param ht_u64_map* map: the Hash Table
+   @param uint64_t key: the key
+ **/
+void ht_u64_delete(ht_u64_map* map, uint64_t key);
+
+#endif
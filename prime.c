@@ -1,7 +1,6 @@
 /* -*- compile-command: "gcc -Wall -pedantic -g3 prime.c -o prime" -*- */
 #include <stdio.h>
 #include <stdlib.h>
-#include <math.h>
 #include "prime.h"
 
 
@@ -12,12 +11,13 @@
  *   0  - not prime
  *   -1 - undefined (i.e. x < 2)
  **/
-int is_prime(const int x)
+int is_prime(const uint64_t x)
 {
     if (x < 2) return -1;
     if (x < 4) return 1;
     if ((x % 2) == 0) return 0;
-    for (int i = 3; i <= floor(sqrt((double) x)); i += 2) {
+    // i <= x / i: no sqrt(), exact for any 64-bit x
+    for (uint64_t i = 3; i <= x / i; i += 2) {
         if ((x % i) == 0) {
             return 0;
         }
@@ -29,9 +29,100 @@ int is_prime(const int x)
 /**
  * Return the next prime after x, or x if x is prime
  **/
-int next_prime(int x)
+uint64_t next_prime(uint64_t x)
 {
     while (is_prime(x) != 1)
         x++;
     return x;
 }
+
+
+/**
+ * Sizes of prime-sized tables: next_prime(50 * 2^k) up to 2^63, so each one
+ * is about twice the previous, with their fastmod constants
+ **/
+static const prime_size PRIME_SIZES[] = {
+    {                  53ULL, 0x04d4873ecade304dULL, 0x4873ecade304d488ULL},
+    {                 101ULL, 0x0288df0cac5b3f5dULL, 0xc83cd4e930288df1ULL},
+    {                 211ULL, 0x013698df3de07479ULL, 0x53b7342bad7f64b4ULL},
+    {                 401ULL, 0x00a36e71a2cb0331ULL, 0x28382df70ff5c919ULL},
+    {                 809ULL, 0x005102370f816c89ULL, 0xf7c5c6686cdaf9fdULL},
+    {                1601ULL, 0x0028ef35e2e5efb0ULL, 0xb08798627f99a9faULL},
+    {                3203ULL, 0x001475f82ad6ff99ULL, 0xb22729cd01ff853dULL},
+    {                6421ULL, 0x000a34ddd50561e0ULL, 0xfb55d69da48a442eULL},
+    {               12809ULL, 0x00051dcc8e61406aULL, 0x2a548a61f89aee5bULL},
+    {               25601ULL, 0x00028f559b4dce94ULL, 0xf963e7f600199959ULL},
+    {               51203ULL, 0x000147a92a4334c0ULL, 0x7d1cd7e329647fc6ULL},
+    {              102407ULL, 0x0000a3d42c497708ULL, 0xcc018cc5db41ec4aULL},
+    {              204803ULL, 0x000051eb367a5b0fULL, 0xa894cecd4df33a4aULL},
+    {              409609ULL, 0x000028f587943286ULL, 0xc17b6444137502b4ULL},
+    {              819229ULL, 0x0000147ab1c4a104ULL, 0x9eeb0a30a0ade763ULL},
+    {             1638431ULL, 0x00000a3d63f150dfULL, 0x021eab7391ccda92ULL},
+    {             3276803ULL, 0x0000051eb80346e1ULL, 0x1558e51e819ce3bfULL},
+    {             6553621ULL, 0x0000028f5b9f55b8ULL, 0x23c24a691e742a3fULL},
+    {            13107229ULL, 0x00000147ade4f76cULL, 0xe13e4adc166ce326ULL},
+    {            26214401ULL, 0x000000a3d709d495ULL, 0x186db50f15f285b5ULL},
+    {            52428841ULL, 0x00000051eb80ebeeULL, 0x31593b8d06de365fULL},
+    {           104857601ULL, 0x00000028f5c288ceULL, 0x703c07ee0ae002e0ULL},
+    {           209715263ULL, 0x000000147ae0e075ULL, 0xf9055b7f55a37e3cULL},
+    {           419430419ULL, 0x0000000a3d709c0eULL, 0xbee58e64adb28049ULL},
+    {           838860817ULL, 0x000000051eb8502dULL, 0xe00db2f661be0864ULL},
+    {          1677721631ULL, 0x000000028f5c282aULL, 0x9930fd08d4a751bfULL},
+    {          3355443229ULL, 0x0000000147ae144bULL, 0x5dcc6ad4f58f3ab9ULL},
+    {          6710886407ULL, 0x00000000a3d70a3aULL, 0x92a3055ffe6d5890ULL},
+    {         13421772823ULL, 0x0000000051eb851cULL, 0x5d638876ea42281aULL},
+    {         26843545607ULL, 0x0000000028f5c28fULL, 0x2e48e8a75147f131ULL},
+    {         53687091251ULL, 0x00000000147ae147ULL, 0x5a85879532830a06ULL},
+    {        107374182427ULL, 0x000000000a3d70a3ULL, 0xcbfb15b57fdc5932ULL},
+    {        214748364827ULL, 0x00000000051eb851ULL, 0xe8c154c9876ea423ULL},
+    {        429496729609ULL, 0x00000000028f5c28ULL, 0xf58793dd97fb7a60ULL},
+    {        858993459211ULL, 0x000000000147ae14ULL, 0x7acf41f212d870dbULL},
+    {       1717986918433ULL, 0x0000000000a3d70aULL, 0x3d631f8a0903fb7bULL},
+    {       3435973836949ULL, 0x000000000051eb85ULL, 0x1ea90ff9724a1cb5ULL},
+    {       6871947673621ULL, 0x000000000028f5c2ULL, 0x8f5b9f559b3d0997ULL},
+    {      13743895347257ULL, 0x0000000000147ae1ULL, 0x47adb71758e21b10ULL},
+    {      27487790694421ULL, 0x00000000000a3d70ULL, 0xa3d701a36e2eb1ccULL},
+    {      54975581388811ULL, 0x0000000000051eb8ULL, 0x51eb83fe5c91d14fULL},
+    {     109951162777633ULL, 0x0000000000028f5cULL, 0x28f5c1b71758e21aULL},
+    {     219902325555203ULL, 0x00000000000147aeULL, 0x147ae142c3c9eeccULL},
+    {     439804651110437ULL, 0x000000000000a3d7ULL, 0x0a3d7094af4f0d85ULL},
+    {     879609302220821ULL, 0x00000000000051ebULL, 0x851eb84fc5048170ULL},
+    {    1759218604441603ULL, 0x00000000000028f5ULL, 0xc28f5c28e219652cULL},
+    {    3518437208883211ULL, 0x000000000000147aULL, 0xe147ae1468db8badULL},
+    {    7036874417766439ULL, 0x0000000000000a3dULL, 0x70a3d70a2d773190ULL},
+    {   14073748835532857ULL, 0x000000000000051eULL, 0xb851eb8518e21966ULL},
+    {   28147497671065609ULL, 0x000000000000028fULL, 0x5c28f5c28f212d78ULL},
+    {   56294995342131283ULL, 0x0000000000000147ULL, 0xae147ae1472617c2ULL},
+    {  112589990684262401ULL, 0x00000000000000a3ULL, 0xd70a3d70a3d6a162ULL},
+    {  225179981368524823ULL, 0x0000000000000051ULL, 0xeb851eb851e92a31ULL},
+    {  450359962737049711ULL, 0x0000000000000028ULL, 0xf5c28f5c28f2eb1dULL},
+    {  900719925474099217ULL, 0x0000000000000014ULL, 0x7ae147ae147ac56eULL},
+    { 1801439850948198403ULL, 0x000000000000000aULL, 0x3d70a3d70a3d6f6aULL},
+    { 3602879701896396841ULL, 0x0000000000000005ULL, 0x1eb851eb851eb420ULL},
+    { 7205759403792793733ULL, 0x0000000000000002ULL, 0x8f5c28f5c28f58c2ULL}
+};
+
+
+/**
+ * Return the smallest tabulated prime size >= x (the largest one if none)
+ **/
+const prime_size* next_prime_size(uint64_t x)
+{
+    const size_t n = sizeof(PRIME_SIZES) / sizeof(PRIME_SIZES[0]);
+    size_t i = 0;
+    while (i < n - 1 && PRIME_SIZES[i].p < x)
+        i++;
+    return &PRIME_SIZES[i];
+}
+
+/**
+ * Return the largest tabulated prime size < x (the smallest one if none)
+ **/
+const prime_size* prev_prime_size(uint64_t x)
+{
+    const size_t n = sizeof(PRIME_SIZES) / sizeof(PRIME_SIZES[0]);
+    size_t i = 0;
+    while (i < n - 1 && PRIME_SIZES[i + 1].p < x)
+        i++;
+    return &PRIME_SIZES[i];
+}
@@ -1,5 +1,42 @@
+#ifndef PRIME_H
+#define PRIME_H
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+
+int is_prime(const uint64_t x);
+uint64_t next_prime(uint64_t x);
+
+/**
+ * Tabulated prime size with its fastmod constant M = ceil(2^128 / p)
+ **/
+typedef struct {
+    uint64_t p;
+    uint64_t m_hi;
+    uint64_t m_lo;
+} prime_size;
+
+const prime_size* next_prime_size(uint64_t x);
+const prime_size* prev_prime_size(uint64_t x);
+
+/**
+ * a % ps->p with multiplies only (Lemire, Kaser, Kurz: "Faster Remainder by
+ * Direct Computation"): the low 128 bits of M * a are the fractional part of
+ * a / p, multiplying them by p brings the remainder above bit 128.
+ * Exact for every 64-bit a.
+ **/
+static inline uint64_t fastmod(const uint64_t a, const prime_size* ps)
+{
+#if defined(__SIZEOF_INT128__)
+    const __uint128_t m = ((__uint128_t)ps->m_hi << 64) | ps->m_lo;
+    const __uint128_t frac = m * a;
+    const __uint128_t bottom = ((__uint128_t)(uint64_t)frac * ps->p) >> 64;
+    const __uint128_t top = (__uint128_t)(uint64_t)(frac >> 64) * ps->p;
+    return (uint64_t)((bottom + top) >> 64);
+#else
+    return a % ps->p;
+#endif
+}
 
-int is_prime(const int x);
-int next_prime(int x);
+#endif